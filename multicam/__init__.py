@@ -1,3 +1,8 @@
-from .multicam import Multicam, Camera, list_cams
-from .backend import is_valid_device, get_formats
-__all__ = ["Multicam", "Camera", "get_formats", "is_valid_device", "list_cams"]
+from .multicam import Multicam, Camera, CameraDisconnected, list_cams, choose_format
+from .hotplug import HotplugSupervisor
+from .discovery import discover, find_device, set_sysfs_root, VideoDevice
+from .capabilities import get_capabilities, get_formats, Capabilities, SizeRange, RateRange
+from .controls import Control
+from .backend import is_valid_device, demosaic
+__all__ = ["Multicam", "Camera", "CameraDisconnected", "Capabilities", "Control", "RateRange", "SizeRange", "choose_format", "demosaic", "discover", "find_device", "get_capabilities", "get_formats", "HotplugSupervisor", "is_valid_device", "list_cams",
+           "set_sysfs_root", "VideoDevice"]
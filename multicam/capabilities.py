@@ -0,0 +1,180 @@
+'''
+  Lazy, cached enumeration of capture formats, frame sizes and frame rates,
+  and of camera controls.
+
+  Each level is only queried when asked for: formats with one VIDIOC_ENUM_FMT
+  pass, sizes per format, and frame intervals per size. Stepwise and
+  continuous ranges are kept as ranges rather than expanded into every mode.
+  Results are cached per device identity (USB ids, serial and port from
+  sysfs), so they survive renumbering of /dev/video nodes.
+'''
+from .backend import enum_formats, enum_framesizes, enum_frameintervals, enum_controls
+from .controls import Control
+from .discovery import discover
+from fractions import Fraction
+from pathlib import Path
+from typing import NamedTuple
+import os
+import threading
+
+__all__ = ["Capabilities", "SizeRange", "RateRange", "get_capabilities", "get_formats"]
+
+V4L2_FMT_FLAG_COMPRESSED = 0x0001
+V4L2_FMT_FLAG_EMULATED = 0x0002
+
+class FormatInfo(NamedTuple):
+    description: str
+    compressed: bool
+    emulated: bool
+
+class SizeRange(NamedTuple):
+    kind: str           #"stepwise" or "continuous"
+    min_width: int
+    max_width: int
+    step_width: int
+    min_height: int
+    max_height: int
+    step_height: int
+
+    def __contains__(self, size):
+        w, h = size
+        return (self.min_width <= w <= self.max_width and self.min_height <= h <= self.max_height
+                and (w - self.min_width) % max(self.step_width, 1) == 0
+                and (h - self.min_height) % max(self.step_height, 1) == 0)
+
+class RateRange(NamedTuple):
+    kind: str           #"stepwise" or "continuous"
+    min_interval: Fraction
+    max_interval: Fraction
+    step_interval: Fraction
+
+    @property
+    def min_fps(self): return float(1/self.max_interval)
+    @property
+    def max_fps(self): return float(1/self.min_interval)
+
+    def __contains__(self, fps):
+        #Steps are uniform in frame interval, not in fps
+        t = 1.0/fps
+        lo, hi = float(self.min_interval), float(self.max_interval)
+        if not (lo*0.995 <= t <= hi*1.005): return False
+        if self.kind == "continuous" or self.step_interval == 0: return True
+        k = (t - lo)/float(self.step_interval)
+        return abs(k - round(k)) * float(self.step_interval) <= 0.005*t
+
+def _rate_matches(rates, fps):
+    if isinstance(rates, RateRange): return fps in rates
+    return any(abs(r - fps) <= 0.005*fps for r in rates)
+
+class Capabilities():
+    '''
+      What a capture device can do, enumerated on demand.
+
+      Methods
+      -------
+       formats() : {fourcc: FormatInfo}
+       sizes(fourcc) : list of (width, height), or a SizeRange
+       rates(fourcc, size) : list of fps, or a RateRange
+       supports(fourcc, size, fps) : Whether the mode exists; at most three
+         enumerations, all cached
+       as_dict() : get_formats-style summary, with ranges kept compact
+       controls() : {key: Control}, keyed by v4l2-ctl style names
+    '''
+    def __init__(self, device):
+        self.device = Path(device)
+        self._formats = None
+        self._sizes = {}
+        self._rates = {}
+        self._controls = None
+        self._lock = threading.Lock()
+
+    def formats(self):
+        with self._lock:
+            if self._formats is None:
+                self._formats = {fourcc.strip(): FormatInfo(desc, bool(flags & V4L2_FMT_FLAG_COMPRESSED),
+                                                            bool(flags & V4L2_FMT_FLAG_EMULATED))
+                                 for fourcc, desc, flags in enum_formats(self.device)}
+            return self._formats
+
+    def _fourcc(self, fourcc):
+        #Codes are stored stripped ("Y16"); the backend pads them again
+        return fourcc.strip()
+
+    def sizes(self, fourcc):
+        fourcc = self._fourcc(fourcc)
+        with self._lock:
+            if fourcc not in self._sizes:
+                res = enum_framesizes(self.device, fourcc)
+                if res and isinstance(res[0][0], str):
+                    res = SizeRange(*res[0])
+                self._sizes[fourcc] = res
+            return self._sizes[fourcc]
+
+    def rates(self, fourcc, size):
+        key = (self._fourcc(fourcc), tuple(size))
+        with self._lock:
+            if key not in self._rates:
+                res = enum_frameintervals(self.device, key[0], key[1])
+                if res and isinstance(res[0][0], str):
+                    kind, lo, hi, step = res[0]
+                    res = RateRange(kind, Fraction(*lo), Fraction(*hi), (Fraction(*step) if step[1] else Fraction(0)))
+                else:
+                    res = [den/num for num, den in res if num]
+                self._rates[key] = res
+            return self._rates[key]
+
+    def supports(self, fourcc, size, fps=None):
+        fourcc, size = self._fourcc(fourcc), tuple(size)
+        if fourcc not in self.formats(): return False
+        sizes = self.sizes(fourcc)
+        if size not in sizes: return False
+        return (fps is None or _rate_matches(self.rates(fourcc, size), fps))
+
+    def controls(self):
+        with self._lock:
+            if self._controls is None:
+                ctrls = [Control.from_backend(c) for c in enum_controls(self.device)]
+                self._controls = {c.key: c for c in ctrls}
+            return self._controls
+
+    def as_dict(self):
+        '''
+          {fourcc: {"description", "compressed", "emulated", "framesizes"}}.
+          "framesizes" maps each discrete (width, height) to its frame rates
+          (a list, or a RateRange), or is a SizeRange for stepwise and
+          continuous devices; rates of a range are left to `rates`.
+        '''
+        res = {}
+        for fourcc, info in self.formats().items():
+            sizes = self.sizes(fourcc)
+            if not isinstance(sizes, SizeRange):
+                sizes = {s: self.rates(fourcc, s) for s in sizes}
+            res[fourcc] = dict(info._asdict(), framesizes=sizes)
+        return res
+
+_cache = {}
+_cache_lock = threading.Lock()
+
+def _identity(device):
+    #Stable key for a node: its USB identity if known, else its sysfs device and path
+    path = Path(os.path.realpath(device))
+    for d in discover():
+        if d.path.name == path.name:
+            if d.vendor_id is not None:
+                return ("usb", d.vendor_id, d.product_id, d.serial, d.usb_path, d.index)
+            return ("sysfs", d.device, d.index)
+    return ("path", str(path))
+
+def get_capabilities(device):
+    '''Cached `Capabilities` of a device path, shared by all users of the same device.'''
+    key = _identity(device)
+    with _cache_lock:
+        caps = _cache.get(key)
+        if caps is None:
+            caps = _cache[key] = Capabilities(device)
+        caps.device = Path(device) #Follow renumbering
+        return caps
+
+def get_formats(device):
+    '''Formats, sizes and frame rates of a device, see `Capabilities.as_dict`.'''
+    return get_capabilities(device).as_dict()
@@ -0,0 +1,173 @@
+'''
+  Continuous capture into bounded per-camera queues.
+
+  Without it, frames wait in the driver's buffer queue until a read takes
+  them, so a consumer that falls behind gets ever older frames, up to the
+  number of buffers, and the driver silently drops the newest. Here a thread
+  per camera keeps dequeuing and converting frames into a queue of fixed
+  depth, and a policy says what happens when the queue is full:
+
+   drop_oldest : The new frame goes in and the oldest is dropped (lowest latency).
+   drop_newest : New frames are dropped until there is room; they are
+     dequeued and requeued without being converted.
+   block : Capture waits for room, leaving the frames to the driver's queue
+     (most complete, latency grows).
+   keep_every_nth_when_behind : While the queue is full, only every n-th new
+     frame is converted and goes in, replacing the oldest; the others are
+     dropped unconverted. The consumer gets a thinned but even history.
+
+  Frames the driver dropped, for want of a free buffer while capture waited
+  or lagged, show as gaps in the sequence numbers of the frames capture
+  took; these are counted apart from the frames the policy dropped.
+
+  The capture threads own their cameras: Camera.read and reconfigure raise
+  while they run. They read without the Multicam lock, which a consumer
+  holds while it waits for frames. A reconnection may swap the backend
+  camera meanwhile; a read in flight keeps the old one alive and fails on
+  it, and the next read uses the new one.
+'''
+from .backend import camsys_read, DeviceLost
+from collections import deque
+from typing import NamedTuple, Optional
+import threading
+import numpy as np
+
+__all__ = ["CaptureQueue", "CapturedFrame", "POLICIES"]
+
+POLICIES = ("drop_oldest", "drop_newest", "block", "keep_every_nth_when_behind")
+
+class CapturedFrame(NamedTuple):
+    image: np.ndarray
+    timestamp: Optional[float]
+    hw_timestamp: Optional[float]
+    sequence: Optional[int]
+
+class CaptureQueue(threading.Thread):
+    '''
+      Captures camera `index` of `camsys` (a Multicam) into a bounded queue.
+
+      Parameters
+      ----------
+       camsys : Multicam
+       index : int
+       depth : int
+         Frames held at most.
+       policy : str
+         One of POLICIES.
+       nth : int
+         Keep one frame in `nth` while behind, for keep_every_nth_when_behind.
+    '''
+    def __init__(self, camsys, index, depth=4, policy="drop_oldest", nth=2):
+        if policy not in POLICIES:
+            raise ValueError(f"Unknown backpressure policy '{policy}'; use {', '.join(POLICIES)}.")
+        if depth < 1: raise ValueError(f"Queue depth must be at least 1, got {depth}.")
+        if nth < 1: raise ValueError(f"nth must be at least 1, got {nth}.")
+        super().__init__(name=f"multicam-capture-{index}", daemon=True)
+        self.camsys = camsys
+        self.index = index
+        self.depth = depth
+        self.policy = policy
+        self.nth = nth
+        self.captured = 0      #Frames converted and queued
+        self.dropped = 0       #Frames dropped by the policy, converted or not
+        self.driver_dropped = 0 #Frames the driver dropped before capture took them
+        self.max_depth = 0
+        self.paused = False
+        self._frames = deque()
+        self._cond = threading.Condition()
+        self._stopping = False
+        self._error = None     #Raised by the next get()
+        self._lost = None      #Backend camera that was found gone
+        self._last = None      #(backend, sequence, frames the backend passed over) of the last frame taken
+
+    @property
+    def camera(self): return self.camsys.cameras[self.index]
+
+    @property
+    def stats(self):
+        with self._cond:
+            return dict(depth=len(self._frames), max_depth=self.max_depth, captured=self.captured,
+                        dropped=self.dropped, driver_dropped=self.driver_dropped, policy=self.policy)
+
+    def stop(self):
+        with self._cond:
+            self._stopping = True
+            self._cond.notify_all()
+
+    def _taken(self, backend, sequence):
+        #Counts the gap to the last frame taken, less the frames the backend
+        #dequeued and passed over itself; a new backend or a restarted stream
+        #renumbers the frames, so nothing is counted across one
+        passed = backend.decimated_frames + backend.stale_frames + backend.corrupt_frames
+        last, self._last = self._last, (backend, sequence, passed)
+        if last is None or last[0] is not backend or sequence <= last[1]: return
+        self.driver_dropped += max(sequence - last[1] - 1 - (passed - last[2]), 0)
+
+    def _wait(self, timeout=0.1):
+        with self._cond:
+            if not self._stopping: self._cond.wait(timeout)
+
+    def run(self):
+        behind = 0
+        while not self._stopping:
+            cam = self.camera
+            backend = cam._v4l2cam
+            if self.paused or cam.state != "connected" or backend is None or backend is self._lost:
+                self._wait()
+                continue
+            with self._cond:
+                full = len(self._frames) >= self.depth
+                if full and self.policy == "block":
+                    self._cond.wait(0.1)
+                    continue
+            behind = (behind + 1 if full else 0)
+            shed = full and (self.policy == "drop_newest" or
+                             (self.policy == "keep_every_nth_when_behind" and behind % self.nth))
+            try:
+                if shed:
+                    sequence = backend.discard()
+                else:
+                    image = camsys_read(self.camsys, [cam], **self.camsys._output)
+                    image = image[0] #A single camera never gives mixed output
+                    frame = CapturedFrame(image, cam.timestamp, cam.hw_timestamp, cam.sequence)
+                    sequence = backend.sequence
+            except DeviceLost as e:
+                if self._stopping or self.paused: continue
+                with self._cond:
+                    self._lost = backend
+                    self._error = e
+                    self._cond.notify_all()
+                continue
+            except Exception as e:
+                if self._stopping or self.paused: continue
+                with self._cond:
+                    self._error = e
+                    self._cond.notify_all()
+                self._wait()
+                continue
+            with self._cond:
+                self._taken(backend, sequence)
+                if shed:
+                    self.dropped += 1
+                    continue
+                if len(self._frames) >= self.depth:
+                    self._frames.popleft()
+                    self.dropped += 1
+                self._frames.append(frame)
+                self.captured += 1
+                self.max_depth = max(self.max_depth, len(self._frames))
+                self._cond.notify_all()
+
+    def get(self):
+        '''Oldest queued frame, waiting for one; raises what capture ran into once the queue is empty.'''
+        with self._cond:
+            while not self._frames and self._error is None and not self._stopping:
+                self._cond.wait()
+            if self._frames:
+                frame = self._frames.popleft()
+                self._cond.notify_all() #Room for block
+                return frame
+            if self._error is not None:
+                e, self._error = self._error, None
+                raise e
+            raise RuntimeError("Capture stopped.")
@@ -0,0 +1,98 @@
+'''
+  Camera controls (exposure, gain, white balance, ...).
+
+  Controls are enumerated once per device with VIDIOC_QUERYCTRL/QUERYMENU and
+  cached with its capabilities. They are addressed by the names v4l2-ctl
+  uses, e.g. "exposure_time_absolute" for "Exposure Time, Absolute". Values
+  are checked against the metadata here, so a batch reaches the driver as a
+  single VIDIOC_S_EXT_CTRLS per camera.
+'''
+from typing import NamedTuple, Optional
+import re
+
+__all__ = ["Control", "control_key", "encode_controls", "decode_control"]
+
+V4L2_CTRL_TYPE_INTEGER = 1
+V4L2_CTRL_TYPE_BOOLEAN = 2
+V4L2_CTRL_TYPE_MENU = 3
+V4L2_CTRL_TYPE_BUTTON = 4
+V4L2_CTRL_TYPE_INTEGER_MENU = 9
+V4L2_CTRL_TYPE_BITMASK = 8
+
+V4L2_CTRL_FLAG_READ_ONLY = 0x0004
+V4L2_CTRL_FLAG_UPDATE = 0x0008
+V4L2_CTRL_FLAG_INACTIVE = 0x0010
+V4L2_CTRL_FLAG_WRITE_ONLY = 0x0040
+
+#Types that fit the 32-bit value of struct v4l2_ext_control
+_SUPPORTED = {V4L2_CTRL_TYPE_INTEGER, V4L2_CTRL_TYPE_BOOLEAN, V4L2_CTRL_TYPE_MENU, V4L2_CTRL_TYPE_BUTTON,
+              V4L2_CTRL_TYPE_INTEGER_MENU, V4L2_CTRL_TYPE_BITMASK}
+
+def control_key(name):
+    '''v4l2-ctl style name of a control: "Exposure Time, Absolute" -> "exposure_time_absolute".'''
+    return re.sub(r"[^a-z0-9]+", "_", name.lower()).strip("_")
+
+class Control(NamedTuple):
+    id: int
+    name: str                 #As reported by the driver
+    type: int                 #V4L2_CTRL_TYPE_*
+    minimum: int
+    maximum: int
+    step: int
+    default: int
+    flags: int
+    menu: Optional[dict]      #{index: name or value} for menu controls
+
+    @property
+    def key(self): return control_key(self.name)
+
+    @property
+    def readable(self): return (self.type in _SUPPORTED and self.type != V4L2_CTRL_TYPE_BUTTON
+                                and not self.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+
+    @property
+    def writable(self): return (self.type in _SUPPORTED and not self.flags & V4L2_CTRL_FLAG_READ_ONLY)
+
+    @classmethod
+    def from_backend(cls, item):
+        id, name, type, minimum, maximum, step, default, flags, menu = item
+        return cls(id, name, type, minimum, maximum, step, default, flags, (None if menu is None else dict(menu)))
+
+    def encode(self, value):
+        #Backend value for `value`, checked against the metadata
+        if not self.writable:
+            raise ValueError(f"Control '{self.key}' cannot be set.")
+        if self.type == V4L2_CTRL_TYPE_MENU and isinstance(value, str):
+            for index, name in self.menu.items():
+                if name.lower() == value.lower(): return index
+            raise ValueError(f"'{value}' is not an option of '{self.key}': {', '.join(self.menu.values())}.")
+        value = int(value)
+        if self.menu is not None and value not in self.menu:
+            raise ValueError(f"{value} is not an option of '{self.key}': {self.menu}.")
+        if self.type == V4L2_CTRL_TYPE_INTEGER and not self.minimum <= value <= self.maximum:
+            raise ValueError(f"'{self.key}' must be in [{self.minimum}, {self.maximum}], got {value}.")
+        return value
+
+def decode_control(ctrl, value):
+    '''Menu entries by name, booleans as bool, others as int.'''
+    if ctrl.type == V4L2_CTRL_TYPE_MENU: return ctrl.menu.get(value, value)
+    if ctrl.type == V4L2_CTRL_TYPE_BOOLEAN: return bool(value)
+    return value
+
+def encode_controls(controls, values):
+    '''
+      [(id, value)] for the backend from {key: value}, given a device's
+      {key: Control}. Controls that change others (auto modes, flagged UPDATE)
+      come first, so e.g. auto_exposure is off before exposure_time_absolute
+      is set; the rest keep their order.
+    '''
+    res = []
+    for key, value in values.items():
+        ctrl = controls.get(key)
+        if ctrl is None:
+            ctrl = next((c for c in controls.values() if c.name == key), None)
+        if ctrl is None:
+            raise ValueError(f"No control '{key}'; available: {', '.join(controls)}.")
+        res.append((not ctrl.flags & V4L2_CTRL_FLAG_UPDATE, ctrl.id, ctrl.encode(value)))
+    res.sort(key=lambda r: r[0])
+    return [(id, value) for _, id, value in res]
@@ -0,0 +1,200 @@
+'''
+  Camera discovery from sysfs, without opening any device node.
+
+  Every /sys/class/video4linux/<name> entry is a symlink into the device tree,
+  e.g. .../usb1/1-2/1-2:1.0/video4linux/video0, from which the node's name,
+  index, driver and USB device (bus path, serial, vendor and product ids) are
+  read. Whether a node captures video comes from udev's database
+  (ID_V4L_CAPABILITIES in /run/udev/data/c<major>:<minor>), which udev fills
+  by querying the node once when it appears. The result is cached and reread
+  when the set of entries or their link targets change, which is all that
+  happens on hotplug, or when udev's database changes.
+'''
+from pathlib import Path
+from typing import NamedTuple, Optional
+import os
+import threading
+
+__all__ = ["VideoDevice", "Discovery", "discover", "find_device", "set_sysfs_root", "sysfs_available"]
+
+class VideoDevice(NamedTuple):
+    path: Path                  #/dev/videoN
+    name: str                   #Device name, e.g. "HD Pro Webcam C920"
+    index: int                  #Node index on its device; UVC metadata nodes have index 1
+    driver: Optional[str]       #Kernel driver of the parent device, e.g. "uvcvideo"
+    device: str                 #sysfs path of the parent device
+    usb_path: Optional[str]     #USB port path such as "1-2.3", stable per physical port
+    serial: Optional[str]
+    vendor_id: Optional[str]
+    product_id: Optional[str]
+    capabilities: Optional[frozenset] = None #From udev, e.g. {"capture"}; None if unknown
+
+    @property
+    def is_metadata(self):
+        #uvcvideo registers a metadata node after each capture node
+        return (self.driver == "uvcvideo" and self.index > 0)
+
+    @property
+    def is_capture(self):
+        '''Whether the node captures video: True, False, or None if udev has no record of it.'''
+        if self.is_metadata: return False
+        if self.capabilities is None: return None
+        return "capture" in self.capabilities
+
+def _read(path):
+    try:
+        return path.read_text().strip()
+    except OSError:
+        return None
+
+def _udev_capabilities(path):
+    #E:ID_V4L_CAPABILITIES=:capture: from a udev database entry
+    try:
+        with open(path) as f:
+            for line in f:
+                if line.startswith("E:ID_V4L_CAPABILITIES="):
+                    return frozenset(c for c in line.strip().split("=", 1)[1].split(":") if c)
+    except OSError:
+        pass
+    return None
+
+class Discovery():
+    '''
+      Cached list of video4linux nodes.
+
+      Parameters
+      ----------
+       sysfs : str or Path
+         sysfs mount point; point at a fake tree for testing.
+       dev : str or Path
+         Directory holding the device nodes.
+       udev : str or Path
+         udev's runtime directory, holding its device database.
+    '''
+    def __init__(self, sysfs="/sys", dev="/dev", udev="/run/udev"):
+        #Resolved, as device paths are compared against resolved link targets
+        self.sysfs = Path(os.path.realpath(sysfs))
+        self.dev = Path(os.path.abspath(dev))
+        self.udev = Path(os.path.abspath(udev))
+        self._key = None
+        self._devices = []
+        self._lock = threading.Lock()
+
+    @property
+    def _class_dir(self):
+        return self.sysfs / "class" / "video4linux"
+
+    def _snapshot(self):
+        #Entry names, link targets and link inodes: cheap to read, and changes on
+        #any hotplug. A node unplugged and registered again under the same name
+        #and target between two calls still gets a new link, with a new inode.
+        try:
+            entries = sorted(os.listdir(self._class_dir))
+        except OSError:
+            return ()
+        key = []
+        for e in entries:
+            try:
+                st = os.lstat(self._class_dir / e)
+                key.append((e, os.readlink(self._class_dir / e), st.st_ino, st.st_ctime_ns))
+            except OSError:
+                key.append((e, None, None, None))
+        try: #udev may record a node only after its entry appears
+            key.append(os.stat(self.udev / "data").st_mtime_ns)
+        except OSError:
+            key.append(None)
+        return tuple(key)
+
+    def _usb_device(self, device):
+        #Walk up from the interface to the USB device, which has idVendor
+        for d in [device, *device.parents]:
+            if d == self.sysfs or self.sysfs not in d.parents: break
+            if (d / "idVendor").exists(): return d
+        return None
+
+    def _node(self, name):
+        entry = self._class_dir / name
+        device = Path(os.path.realpath(entry / "device"))
+        driver = (entry / "device" / "driver")
+        usb = self._usb_device(device)
+        try:
+            index = int(_read(entry / "index") or 0)
+        except ValueError:
+            index = 0
+        devnum = _read(entry / "dev") #major:minor
+        return VideoDevice(
+            path=self.dev / name,
+            name=_read(entry / "name") or "",
+            index=index,
+            driver=(os.path.basename(os.path.realpath(driver)) if driver.exists() else None),
+            device=str(device),
+            usb_path=(usb.name if usb else None),
+            serial=(_read(usb / "serial") if usb else None),
+            vendor_id=(_read(usb / "idVendor") if usb else None),
+            product_id=(_read(usb / "idProduct") if usb else None),
+            capabilities=(_udev_capabilities(self.udev / "data" / f"c{devnum}") if devnum else None))
+
+    def devices(self, refresh=False):
+        '''All video4linux nodes, sorted by name.'''
+        with self._lock:
+            key = self._snapshot()
+            if refresh or key != self._key:
+                names = sorted((k[0] for k in key[:-1]), key=lambda n: (len(n), n))
+                self._devices = [self._node(n) for n in names]
+                self._key = key
+            return list(self._devices)
+
+    def find(self, usb_path=None, serial=None, by_id=None, by_path=None, name=None):
+        '''
+          The capture node matching all given selectors. `by_id` and `by_path`
+          are udev link names in /dev/v4l/by-id and /dev/v4l/by-path.
+        '''
+        selectors = dict(usb_path=usb_path, serial=serial, by_id=by_id, by_path=by_path, name=name)
+        selectors = {k: v for k, v in selectors.items() if v is not None}
+        if not selectors: raise ValueError("No device selector given.")
+        nodes = {}
+        for link in ("by_id", "by_path"):
+            if link in selectors:
+                p = self.dev / "v4l" / link.replace("_", "-") / selectors[link]
+                if not os.path.lexists(p): raise ValueError(f"No such device '{p}'.")
+                nodes[link] = os.path.basename(os.path.realpath(p))
+        matches = [d for d in self.devices() if d.is_capture is not False
+                   and selectors.get("usb_path", d.usb_path) == d.usb_path
+                   and selectors.get("serial", d.serial) == d.serial
+                   and selectors.get("name", d.name) == d.name
+                   and all(d.path.name == n for n in nodes.values())]
+        desc = ", ".join(f"{k}={v!r}" for k, v in selectors.items())
+        if not matches: raise ValueError(f"No camera with {desc}.")
+        if len(matches) > 1:
+            raise ValueError(f"{len(matches)} cameras match {desc}: {', '.join(str(d.path) for d in matches)}.")
+        return matches[0]
+
+    def invalidate(self):
+        with self._lock:
+            self._key = None
+
+_discovery = Discovery()
+
+def discover(refresh=False):
+    '''
+      List video4linux nodes from sysfs without opening them. Cached; the
+      cache follows hotplug, and `refresh=True` forces a reread.
+    '''
+    return _discovery.devices(refresh)
+
+def find_device(usb_path=None, serial=None, by_id=None, by_path=None, name=None):
+    '''
+      Find a camera by a stable identity rather than its /dev/videoN number,
+      from the discovery cache. Returns a `VideoDevice`; raises ValueError if
+      no camera or more than one matches.
+    '''
+    return _discovery.find(usb_path, serial, by_id, by_path, name)
+
+def sysfs_available():
+    '''Whether the sysfs tree has a video4linux class at all.'''
+    return _discovery._class_dir.is_dir()
+
+def set_sysfs_root(sysfs="/sys", dev="/dev", udev="/run/udev"):
+    '''Read discovery data from another sysfs tree, e.g. a fake one in tests.'''
+    global _discovery
+    _discovery = Discovery(sysfs, dev, udev)
@@ -0,0 +1,93 @@
+'''
+  Clock drift between cameras, and prediction of matching frames.
+
+  Each camera's crystal runs tens of ppm off nominal, so cameras that start
+  aligned slide apart by a frame every few minutes, and pairing frames by a
+  fixed timestamp tolerance eventually pairs the wrong ones. Instead, each
+  camera's capture times are modelled as a line over its frame sequence
+  numbers, t = offset + period*sequence, fitted by recursive least squares
+  with exponential forgetting so the fit follows temperature drift. From the
+  models, the sequence number of each camera's frame closest to a given time
+  is predicted, and reads ask the backend for those frames.
+'''
+import math
+
+__all__ = ["ClockModel", "drift_report"]
+
+class ClockModel():
+    '''
+      Capture time as a function of frame sequence number for one camera.
+
+      Parameters
+      ----------
+       period : float
+         Nominal frame interval in seconds, the starting estimate.
+       forgetting : float
+         RLS forgetting factor; 0.999 weighs roughly the last 1000 frames.
+    '''
+    MIN_SAMPLES = 4
+
+    def __init__(self, period, forgetting=0.999):
+        self.nominal = period
+        self.forgetting = forgetting
+        self.reset()
+
+    def reset(self):
+        #Forget the stream, e.g. after a restart renumbered its frames
+        self.n = 0
+        self.s0 = self.t0 = None
+        self.last = None                 #(sequence, time) of the latest sample
+        self.theta = [0.0, self.nominal] #Offset and period, relative to (s0, t0)
+        self.P = [[1e6, 0.0], [0.0, 1e6]]
+        self.jitter = 0.0                #RMS residual, seconds
+
+    @property
+    def ready(self): return self.n >= self.MIN_SAMPLES
+
+    @property
+    def period(self): return self.theta[1]
+
+    def update(self, sequence, t):
+        '''Adds the capture time `t` of frame `sequence`.'''
+        if self.last is not None:
+            if sequence <= self.last[0]: self.reset() #Restarted stream
+            elif self.ready and abs(t - self.predict(sequence)) > self.period/2: self.reset()
+        if self.s0 is None: self.s0, self.t0 = sequence, t
+        x = (1.0, float(sequence - self.s0))
+        y = t - self.t0
+        P, lam = self.P, self.forgetting
+        Px = (P[0][0]*x[0] + P[0][1]*x[1], P[1][0]*x[0] + P[1][1]*x[1])
+        denom = lam + x[0]*Px[0] + x[1]*Px[1]
+        k = (Px[0]/denom, Px[1]/denom)
+        err = y - (self.theta[0] + self.theta[1]*x[1])
+        self.theta = [self.theta[0] + k[0]*err, self.theta[1] + k[1]*err]
+        self.P = [[(P[i][j] - k[i]*Px[j])/lam for j in range(2)] for i in range(2)]
+        if self.ready: self.jitter = math.sqrt(0.95*self.jitter**2 + 0.05*err**2)
+        self.n += 1
+        self.last = (sequence, t)
+
+    def predict(self, sequence):
+        '''Capture time of frame `sequence`.'''
+        return self.t0 + self.theta[0] + self.theta[1]*(sequence - self.s0)
+
+    def sequence_at(self, t):
+        '''Sequence number of the frame captured closest to `t`.'''
+        return self.s0 + round((t - self.t0 - self.theta[0])/self.theta[1])
+
+def drift_report(models, reference):
+    '''
+      Per camera: its fitted `period`, `ppm` rate difference to the reference
+      camera, `offset` in seconds of its nearest frame to the reference's
+      latest one, and `jitter`, the RMS timestamp residual. None where a model
+      is not ready yet.
+    '''
+    ref = models[reference]
+    res = []
+    for m in models:
+        if not (m.ready and ref.ready):
+            res.append(None)
+            continue
+        t = ref.last[1]
+        res.append(dict(period=m.period, ppm=(m.period/ref.period - 1)*1e6,
+                        offset=m.predict(m.sequence_at(t)) - t, jitter=m.jitter))
+    return res
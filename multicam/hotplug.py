@@ -0,0 +1,118 @@
+'''
+  Reconnection of cameras that are unplugged or reset while running.
+
+  A supervisor thread watches /dev with inotify (polling if unavailable).
+  When a camera's node disappears, or a read fails with ENODEV, the camera is
+  marked disconnected and torn down on its own; the other cameras keep
+  streaming. When a matching node appears again (found through the sysfs
+  discovery by USB port and serial), the camera is reopened with its previous
+  settings and swapped in.
+'''
+import ctypes
+import os
+import select
+import struct
+import threading
+
+__all__ = ["HotplugSupervisor"]
+
+IN_ATTRIB = 0x00000004
+IN_CREATE = 0x00000100
+IN_DELETE = 0x00000200
+IN_NONBLOCK = 0o4000
+IN_CLOEXEC = 0o2000000
+_EVENT = struct.Struct("iIII")
+
+class _DevWatcher():
+    #inotify on the device directory; yields (name, mask) for video nodes
+    def __init__(self, dev="/dev"):
+        self.fd = -1
+        try:
+            libc = ctypes.CDLL(None, use_errno=True)
+            fd = libc.inotify_init1(IN_NONBLOCK | IN_CLOEXEC)
+            if fd < 0: return
+            if libc.inotify_add_watch(fd, os.fsencode(dev), IN_CREATE | IN_DELETE | IN_ATTRIB) < 0:
+                os.close(fd)
+                return
+            self.fd = fd
+        except (OSError, AttributeError):
+            self.fd = -1
+
+    def read(self):
+        events = []
+        try:
+            data = os.read(self.fd, 4096)
+        except (BlockingIOError, OSError):
+            return events
+        i = 0
+        while i + _EVENT.size <= len(data):
+            _, mask, _, length = _EVENT.unpack_from(data, i)
+            name = data[i + _EVENT.size:i + _EVENT.size + length].rstrip(b"\0").decode(errors="replace")
+            i += _EVENT.size + length
+            if name.startswith("video"): events.append((name, mask))
+        return events
+
+    def close(self):
+        if self.fd != -1: os.close(self.fd)
+        self.fd = -1
+
+class HotplugSupervisor(threading.Thread):
+    '''
+      Keeps `cameras` (Camera objects) connected.
+
+      Parameters
+      ----------
+       cameras : list of Camera
+       interval : float
+         Seconds between reconnection attempts while a camera is disconnected;
+         also the polling period when inotify is not available.
+       dev : str
+         Directory of the device nodes.
+    '''
+    def __init__(self, cameras, interval=1.0, dev="/dev"):
+        super().__init__(name="multicam-hotplug", daemon=True)
+        self.cameras = cameras
+        self.interval = interval
+        self.dev = dev
+        self._stopping = threading.Event()
+        self._wake_r, self._wake_w = os.pipe()
+
+    def notify(self):
+        #Wake the thread, e.g. after a read found a camera gone
+        try:
+            os.write(self._wake_w, b"x")
+        except OSError:
+            pass
+
+    def stop(self):
+        self._stopping.set()
+        self.notify()
+        if self.is_alive() and threading.current_thread() is not self: self.join()
+        for fd in (self._wake_r, self._wake_w):
+            try:
+                os.close(fd)
+            except OSError:
+                pass
+
+    def run(self):
+        watcher = _DevWatcher(self.dev)
+        try:
+            while not self._stopping.is_set():
+                fds = [self._wake_r] + ([watcher.fd] if watcher.fd != -1 else [])
+                waiting = any(c.state == "disconnected" for c in self.cameras)
+                timeout = (self.interval if (waiting or watcher.fd == -1) else None)
+                ready, _, _ = select.select(fds, [], [], timeout)
+                if self._wake_r in ready: os.read(self._wake_r, 4096)
+                if self._stopping.is_set(): break
+                removed = set()
+                if watcher.fd in ready:
+                    removed = {name for name, mask in watcher.read() if mask & IN_DELETE}
+                for cam in self.cameras:
+                    gone = (cam.node in removed if watcher.fd != -1 else (cam.path is not None and not os.path.exists(cam.path)))
+                    if cam.state == "connected" and gone:
+                        cam._lost()
+                for cam in self.cameras:
+                    if cam.state == "disconnected" and not self._stopping.is_set():
+                        cam.reconnect()
+        finally:
+            watcher.close()
@@ -1,8 +1,33 @@
-from .backend import v4l2cam, camsys_read, is_valid_device, get_formats
+from .backend import v4l2cam, camsys_read, camsys_start, camsys_set_controls, is_valid_device, DeviceLost
+from .capabilities import get_capabilities, get_formats, RateRange
+from .controls import encode_controls, decode_control
+from .discovery import discover, find_device, sysfs_available
+from .hotplug import HotplugSupervisor
+from .phase import PhaseTracker
+from .drift import ClockModel, drift_report
+from .capture import CaptureQueue
 from pathlib import Path
 import numpy as np
+import threading
+import time
 
-__all__ = ["Multicam", "Camera", "list_cams"]
+__all__ = ["Multicam", "Camera", "CameraDisconnected", "list_cams", "choose_format"]
+
+class CameraDisconnected(DeviceLost):
+    '''A read hit cameras that are unplugged or not yet reconnected; see `cameras`.'''
+    def __init__(self, cameras):
+        super().__init__(f"Camera(s) {', '.join(map(str, cameras))} disconnected", list(cameras))
+        self.cameras = list(cameras)
+
+#Conversion cost to RGB in ns per pixel, measured with libyuv on one x86-64 core at 1080p.
+#Bayer formats use multicam's bilinear demosaic ("edge" costs ~3x more). Emulated formats (converted
+#by libv4l before multicam sees them) pay for that conversion as well.
+FORMAT_COST = {
+    "YU12": 0.27, "YV12": 0.27, "YUYV": 0.28, "YVYU": 0.30, "UYVY": 0.30, "RGB3": 0.32, "BGR3": 0.32,
+    "NV12": 0.37, "NV21": 0.37, "NM12": 0.37, "NM21": 0.37, "YM12": 0.27, "YM21": 0.27, "YM16": 0.30,
+    "BA81": 5.8, "GBRG": 5.8, "GRBG": 5.8, "RGGB": 5.8, "MJPG": 1.74, "JPEG": 1.74,
+}
+EMULATED_COST = 0.5
 
 class Camera():
     '''
@@ -10,24 +35,90 @@ class Camera():
       
       Parameters
       ----------
-       dev : str, Path or int
-         Video capture device path or integer, specifing /dev/video<N> device.
+       dev : str, Path, int, dict or None
+         Video capture device path or integer, specifing /dev/video<N> device, or a
+         selector dict with keys "usb_path", "serial", "by_id", "by_path" and/or "name",
+         resolved with `find_device` each time the camera starts.
        size : tuple (width, height)
        format : str
-         FOURCC string (e.g. "MJPG" or YUYV")
+         FOURCC string (e.g. "MJPG" or YUYV"), or "auto" to pick the cheapest format
+         to convert that the device offers at `size` and `fps`; see `choose_format`.
+         The choice and its reason are in `format_choice`. 8-bit Bayer formats ("RGGB", "GRBG",
+         "GBRG", "BA81"/"BGGR") are demosaiced by multicam. High bit depth greyscale
+         and depth formats ("Y10", "Y12", "Y14", "Y16", "Z16", and packed "Y10P",
+         "Y10B") give (H,W) uint16 arrays.
        fps : int
+       rotation : int
+         Clockwise rotation in degrees (0, 90, 180 or 270). The output shape follows the rotation.
+       flip : str or None
+         Mirror the output horizontally ('h'), vertically ('v') or both ('hv'), after rotation.
+       remap : tuple (map_x, map_y) or None
+         Dense float maps as for cv2.remap, giving for each output pixel its source
+         position in the rotated and flipped frame. The output takes the maps' shape.
+       demosaic : str
+         Demosaic algorithm for Bayer formats: "nearest", "bilinear" or "edge"
+         (edge-directed). "raw" returns the (H,W) mosaic unchanged, see `multicam.demosaic`.
+       usb_path, serial, by_id : str or None
+         Shorthand for a selector `dev`, e.g. Camera(usb_path="1-2.3"); `dev` must be None.
+       skip_corrupt : int
+         Corrupt frames (truncated JPEG, short raw frames, frames flagged by the
+         driver) skipped in a row within one read, before it raises; 0 raises on
+         the first. Counted in `frame_stats`.
+       stall_timeout : float, "auto" or None
+         Seconds without a frame after which a background watchdog restarts the
+         stream (STREAMOFF/STREAMON), or reopens the device if that did not help.
+         "auto" allows 10 frame intervals, at least 2 s. None disables it.
+       metadata : bool or str
+         Also stream the UVC metadata node paired with the video node (found
+         through sysfs, or given as a path), and fit its device clock to
+         CLOCK_MONOTONIC to give `hw_timestamp`. Needs uvcvideo with metadata
+         support (Linux 4.16+).
+       decimate : int
+         Give only every `decimate`-th frame, e.g. 3 for 20 fps from a 60 fps
+         stream. The others are requeued as soon as they are dequeued, without
+         conversion. Frames are kept by driver sequence number, so `sequence` and
+         `timestamp` stay those of the frame given, and frames the driver drops
+         do not shift the cadence.
       
       Attributes
       ----------
        started : Bool; Is camera started?
+       state : str; "stopped", "connected" or "disconnected" (unplugged or reset,
+         see `reconnect` and `Multicam(reconnect=True)`).
+       format_choice : tuple (fourcc, reason) or None; Outcome of format="auto".
+       frame_stats : dict; Corrupt, skipped and driver-flagged frames, stale frames
+         passed over for frame pairing or scheduling, frames left out by
+         `decimate`, frames repeated by the scheduler, and stalls handled by the watchdog (restarts, reopens), since start.
+       timestamp : float or None; Capture time of the last frame read, in seconds on
+         CLOCK_MONOTONIC (as time.monotonic()), taken at the middle of its exposure
+         whether the driver stamps the start of exposure or the end of the frame,
+         so cameras with different exposure times compare directly.
+       hw_timestamp : float or None; As `timestamp`, from the device clock (UVC
+         PTS mapped through the fitted clock model) rather than the time the
+         driver saw the frame; None without `metadata`, until about 8 frames
+         have been read, or if the camera sends no PTS.
+       device_clock_hz : float or None; Device clock rate estimated by the fit.
+       sequence : int or None; Driver sequence number of the last frame read.
       
       Methods
       -------
        start() : Start camera
        stop() : Stop camera
+       pause() : Stop streaming, keeping the device open and its buffers mapped
+       resume() : Restart streaming after `pause`
+       reconfigure(size=None, format=None, fps=None) :
+         Change settings without reopening the device. Buffers are reallocated
+         only if size or format change.
        read(n=None) :
          if `n` is not `None`; read `n` frames.
        get_formats() : Get available formats, resolutions and framerates
+       controls : {key: Control}; Controls of the device, cached per device
+       get_controls(*keys) : {key: value}; All readable controls if none given
+       set_controls(values=None, **kwargs) :
+         Set controls by key, e.g. set_controls(auto_exposure="Manual Mode",
+         exposure_time_absolute=100), with one VIDIOC_S_EXT_CTRLS.
+       reconnect() : Reopen a disconnected camera, at its new node if renumbered;
+         returns whether it succeeded
          
       Examples
       --------
@@ -41,12 +132,67 @@ class Camera():
       with Camera("/dev/video0", "/dev/video2") as c:
           data = c.read()
     '''
-    def __init__(self, dev, size=(640,480), format="MJPG", fps=30):
+    def __init__(self, dev=None, size=(640,480), format="MJPG", fps=30, rotation=0, flip=None, remap=None,
+                 demosaic="bilinear", *, usb_path=None, serial=None, by_id=None, skip_corrupt=3,
+                 stall_timeout=None, metadata=False, decimate=1):
+        selector = {k: v for k, v in dict(usb_path=usb_path, serial=serial, by_id=by_id).items() if v is not None}
+        if selector:
+            if dev is not None: raise ValueError("Give either `dev` or a selector, not both.")
+            dev = selector
+        if dev is None: raise ValueError("No device given.")
         self.dev = dev
         self.size = size
         self.format = format
         self.fps = fps
+        self.rotation = rotation
+        self.flip = flip
+        self.remap = remap
+        self.demosaic = demosaic
+        self.skip_corrupt = skip_corrupt
+        self.stall_timeout = stall_timeout
+        self.metadata = metadata
+        self.decimate = decimate
+        self.format_choice = None
+        self.state = "stopped"
+        self.path = None       #Node in use, e.g. /dev/video2
+        self.last_error = None #Of the last failed reconnection
+        self._identity = None  #VideoDevice of the node, to find it again after a replug
         self._v4l2cam = None
+        self._lock = threading.RLock() #Shared with the owning Multicam
+        self._capture = None   #CaptureQueue that owns the camera, see Multicam(continuous=True)
+    
+    @property
+    def frame_stats(self):
+        c = self._v4l2cam
+        if c is None:
+            return dict(corrupt=0, skipped=0, driver_errors=0, stale=0, decimated=0, repeated=0, stalls=0,
+                        restarts=0, reopens=0)
+        return dict(corrupt=c.corrupt_frames, skipped=c.skipped_frames, driver_errors=c.error_frames,
+                    stale=c.stale_frames, decimated=c.decimated_frames, repeated=c.repeated_frames,
+                    stalls=c.stalls, restarts=c.stall_restarts, reopens=c.stall_reopens)
+    
+    @property
+    def timestamp(self):
+        c = self._v4l2cam
+        return (None if c is None or c.timestamp == 0 else c.timestamp * 1e-9)
+    
+    @property
+    def hw_timestamp(self):
+        c = self._v4l2cam
+        return (None if c is None or c.hw_timestamp == 0 else c.hw_timestamp * 1e-9)
+    
+    @property
+    def sequence(self):
+        c = self._v4l2cam
+        return (None if c is None or c.timestamp == 0 else c.sequence)
+    
+    @property
+    def device_clock_hz(self):
+        c = self._v4l2cam
+        return (None if c is None or c.device_clock_hz == 0 else c.device_clock_hz)
+    
+    @property
+    def node(self): return (None if self.path is None else Path(self.path).name)
     
     @property
     def width(self): return self.size[0]
@@ -55,38 +201,162 @@ class Camera():
         
     def _devpath(self):
         d = self.dev
+        if isinstance(d, dict): return find_device(**d).path
         if isinstance(d, int): d = f"/dev/video{d}"
         d = Path(d)
         if not d.exists(): raise ValueError(f"No such device '{d}'.")
         return d
    
     def get_formats(self):
-        return get_formats(self.dev)
+        return get_formats(self._devpath())
    
     @property
     def started(self):
         return ((self._v4l2cam is not None) and (self._v4l2cam.fd != -1))
     
-    def start(self):
+    def _build(self, d):
+        #Backend camera for node `d`, configured but not opened
+        format = self.format
+        if format == "auto":
+            if self.format_choice is None:
+                self.format_choice = choose_format(get_capabilities(d), self.size, self.fps)
+            format = self.format_choice[0]
+        stall = {None: -1.0, "auto": 0.0}.get(self.stall_timeout, self.stall_timeout)
+        meta = (self._metadata_node(d) if self.metadata is True else (str(self.metadata) if self.metadata else None))
+        cam = v4l2cam(d, self.size, format, self.fps, self.rotation, self.flip, self.demosaic, self.skip_corrupt, stall,
+                      meta, self.decimate)
+        if self.remap is not None: cam.set_remap(*self.remap)
+        return cam
+    
+    def _metadata_node(self, d):
+        #Metadata node registered by uvcvideo right after the capture node `d`
+        devices = discover()
+        video = next((v for v in devices if v.path.name == Path(d).name), None)
+        meta = (None if video is None else
+                next((v for v in sorted(devices, key=lambda v: v.index)
+                      if v.is_metadata and v.device == video.device and v.index > video.index), None))
+        if meta is None: raise ValueError(f"No UVC metadata node found for '{d}'.")
+        return str(meta.path)
+    
+    def _configure(self):
+        #Set up the backend camera without opening the device
         self.stop() #Restart if already started
+        d = self._devpath()
+        self.format_choice = None
+        self._v4l2cam = self._build(d)
+        self._connected(d)
+    
+    def _connected(self, d):
+        self.path = str(d)
+        self._identity = next((v for v in discover() if v.path.name == Path(d).name), None)
+    
+    def start(self):
         try:
-            d = self._devpath()
-            self._v4l2cam = v4l2cam(d, self.size, self.format, self.fps)
+            self._configure()
             self._v4l2cam.start()
+            self.state = "connected"
         except Exception as e:
             self.stop()
             raise e
     
     def stop(self):
+        self.state = "stopped"
         if self.started: self._v4l2cam.stop()
     
-    def read(self, n=None):
+    def _lost(self):
+        #Release the dead device; the others of a Multicam are not touched
+        with self._lock:
+            if self.state != "connected": return
+            self.state = "disconnected"
+            try:
+                if self.started: self._v4l2cam.stop()
+            except Exception:
+                pass
+    
+    def _reconnect_path(self):
+        if isinstance(self.dev, dict): return find_device(**self.dev).path
+        v = self._identity
+        if v is not None and v.usb_path is not None:
+            return find_device(usb_path=v.usb_path, serial=v.serial).path
+        return self._devpath()
+    
+    def reconnect(self):
+        if self.state != "disconnected": return (self.state == "connected")
+        try:
+            d = self._reconnect_path()
+            cam = self._build(d)
+            cam.start() #Slow; done before taking the lock so reads of other cameras go on
+        except Exception as e:
+            self.last_error = e
+            return False
+        with self._lock:
+            if self.state != "disconnected": #Stopped meanwhile
+                cam.stop()
+                return False
+            self._v4l2cam = cam
+            self._connected(d)
+            self.last_error = None
+            self.state = "connected"
+        return True
+    
+    def pause(self):
+        if not self.started:
+            raise RuntimeError("Camera has not been started")
+        self._v4l2cam.pause()
+    
+    def resume(self):
+        if not self.started:
+            raise RuntimeError("Camera has not been started")
+        self._v4l2cam.resume()
+    
+    @property
+    def controls(self):
+        return get_capabilities(self.path or self._devpath()).controls()
+    
+    def get_controls(self, *keys):
+        if not self.started:
+            raise RuntimeError("Camera has not been started")
+        controls = self.controls
+        ctrls = ([_control(controls, k) for k in keys] if keys else [c for c in controls.values() if c.readable])
+        values = self._v4l2cam.get_controls([c.id for c in ctrls])
+        return {c.key: decode_control(c, v) for c, v in zip(ctrls, values)}
+    
+    def set_controls(self, values=None, **kwargs):
         if not self.started:
             raise RuntimeError("Camera has not been started")
-        if n is not None:
-            return np.stack([self._v4l2cam.read() for _ in range(n)])
+        camsys_set_controls([self._v4l2cam], [encode_controls(self.controls, {**(values or {}), **kwargs})])
+    
+    def _check_owner(self):
+        if self._capture is not None:
+            raise RuntimeError("Camera is read by continuous capture; stop the Multicam first.")
+    
+    def reconfigure(self, size=None, format=None, fps=None):
+        self._check_owner()
+        if format == "auto":
+            self.format_choice = choose_format(get_capabilities(self._devpath()), size or self.size, fps or self.fps)
+            fourcc = self.format_choice[0]
         else:
-            return self._v4l2cam.read()
+            fourcc = format
+        if self._v4l2cam is not None:
+            self._v4l2cam.reconfigure(size=(None if size is None else tuple(size)), format=fourcc, fps=(fps or 0))
+        if size is not None: self.size = size
+        if format is not None: self.format = format
+        if fps is not None: self.fps = fps
+    
+    def read(self, n=None):
+        self._check_owner()
+        with self._lock:
+            if self.state == "disconnected": raise CameraDisconnected([0])
+            if not self.started:
+                raise RuntimeError("Camera has not been started")
+            try:
+                if n is not None:
+                    return np.stack([self._v4l2cam.read() for _ in range(n)])
+                else:
+                    return self._v4l2cam.read()
+            except DeviceLost:
+                self._lost()
+                raise CameraDisconnected([0]) from None
     
     def __enter__(self):
         self.start()
@@ -99,29 +369,142 @@ class Camera():
 class Multicam():
     '''
       Set up a system of cameras for synchronized reading.
-      Note: The cameras must all support the same settings.
       
       Parameters
       ----------
        devs : list
-         Video capture device paths or integers, specifing /dev/video<N> devices.
-       size : tuple (width, height)
-       format : str
-         FOURCC string (e.g. "MJPG" or YUYV")
-       fps : int
+         Video capture device paths or integers, specifing /dev/video<N> devices,
+         or selector dicts such as {"usb_path": "1-2.3"}; see `Camera`.
+       size : tuple (width, height) or list
+         Capture size, for all cameras or one (width, height) per camera.
+       format : str or list
+         FOURCC string (e.g. "MJPG" or YUYV") or "auto", for all cameras or one per camera.
+       fps : int or list
+         Frame rate, for all cameras or one per camera.
+       rotation : int or list
+         Clockwise rotation in degrees, for all cameras or one per camera.
+         Cameras that end up with different output shapes are read as a list.
+       flip : str, None or list
+         'h', 'v', 'hv' or None, for all cameras or one per camera.
+       remap : list or None
+         One (map_x, map_y) tuple or None per camera; see `Camera`.
+       demosaic : str or list
+         Bayer demosaic algorithm, for all cameras or one per camera; see `Camera`.
+       layout : str
+         "nhwc" gives (N,H,W,3) arrays, "nchw" gives (N,3,H,W) tensors and
+         "grid" gives one (rows*H, cols*W, 3) mosaic with a tile per camera.
+       dtype : numpy dtype
+         uint8, or float32/float16 (requires layout "nchw").
+       mean, std : 3-tuples or None
+         Per-channel (R,G,B) normalization of float output, in [0,1] pixel units:
+         out = (pixel/255 - mean)/std. Mutually exclusive with `scale`/`offset`.
+       scale, offset : 3-tuples or None
+         Per-channel normalization in raw pixel units: out = pixel*scale + offset.
+         Float output defaults to pixel/255.
+       letterbox : tuple (width, height), "max" or None
+         Scale each frame to fit this size, keeping aspect ratio, and pad the border.
+         "max" uses the largest camera output, so cameras of different sizes give
+         one tensor; frames that already have that size are copied unscaled.
+       pad : int
+         Raw pixel value (0-255) of the letterbox border, normalized like the image.
+       grid : tuple (rows, cols) or None
+         Mosaic shape for layout "grid". Defaults to a near-square grid.
+       tile : tuple (width, height), "max" or None
+         Tile size for layout "grid"; frames are scaled (letterboxed) to fit.
+       skip_corrupt : int or list
+         Corrupt frames skipped in a row per camera and read, see `Camera`.
+       stall_timeout : float, "auto", None or list
+         Restart cameras that stop delivering frames, see `Camera`. Only the
+         stalled camera is restarted.
+       metadata : bool or list
+         Stream UVC metadata for device clock timestamps, see `Camera`.
+       decimate : int or list
+         Give every k-th frame per camera, skipping the decode of the others, see `Camera`.
+       pairing : bool
+         Predict from each camera's clock model (see `drift`) which of its frames
+         was captured closest to the reference camera's latest frame, and have
+         reads pass over older queued frames to return that one. Reads then give
+         matching and fresh sets even when the consumer falls behind.
+       reference : int
+         Camera the others are paired to and compared with in `drift`.
+       rate : float or None
+         Fixed output rate in Hz. Each read waits for the next tick of a steady
+         CLOCK_MONOTONIC schedule and gives, per camera, the frame captured
+         closest to the tick time less `latency`: older frames are passed over
+         without decoding, and the last frame is given again when no newer one
+         is closer. See `schedule_stats`. Takes precedence over `pairing`.
+       latency : float or None
+         How far the scheduled sample time lags the tick, so the chosen frames
+         have arrived by then. Defaults to 1.5 frame intervals of the slowest camera.
+       continuous : bool
+         Capture continuously in a thread per camera into a bounded queue, which
+         reads take the oldest frames from, instead of leaving frames in the
+         driver's queue until a read. Not with `rate`, `pairing` or layout "grid".
+       queue_size : int or list
+         Frames each camera's queue holds.
+       backpressure : str or list
+         What capture does when a queue is full: "drop_oldest" (lowest latency),
+         "drop_newest", "block" (leave frames to the driver; most complete) or
+         "keep_every_nth_when_behind" (keep every `keep_every`-th frame, dropping
+         the oldest queued one for it). Dropped frames are not converted, except
+         those drop_oldest evicts. See `multicam.capture`.
+       keep_every : int
+         n for "keep_every_nth_when_behind".
+       reconnect : bool
+         Run a `HotplugSupervisor` that reopens unplugged or reset cameras when
+         they come back, with the same settings, while the others keep streaming.
       
       Attributes
       ----------
        started : Bool; Are cameras started?
+       states : list of str; Connection state of each camera, see `Camera.state`.
+       frame_stats : list of dict; `Camera.frame_stats` of each camera.
+       timestamps : list of float; Mid-exposure capture times of the frames of
+         the last read, see `Camera.timestamp`.
+       hw_timestamps : list of float or None; Device clock capture times, see
+         `Camera.hw_timestamp`.
+       drift : list of dict or None; Per camera, from a recursive least squares fit
+         of capture time over sequence number: frame `period`, rate difference
+         to the reference in `ppm`, `offset` of its nearest frame to the
+         reference's last one, and timestamp `jitter`, all in seconds.
+       pairing_errors : list of float; Capture time of each camera's last frame
+         less the reference's, for the last read.
+       queue_stats : list of dict or None; With `continuous`, per camera the queue
+         "depth" now, "max_depth" reached, frames "captured", "dropped" by the
+         policy and "driver_dropped" before capture took them.
+       tick : float or None; Sample time (CLOCK_MONOTONIC seconds) of the set given by
+         the last scheduled read.
+       schedule_stats : dict; With `rate`: "ticks" served, "missed" ticks (reads
+         came too late), and per camera the frames "duplicated" and "dropped"
+         to hold the rate.
+       phase_offsets : list of float or None; Offset of each camera's frames to
+         the reference camera's, in seconds, while `align_phase` monitors them.
       
       Methods
       -------
        start() : Start cameras
        stop() : Stop cameras
+       pause() : Stop streaming on all cameras, keeping them open
+       resume() : Restart streaming after `pause`
+       set_controls(values=None, ids=None, **kwargs) :
+         Set controls on all cameras (or those in `ids`) in parallel; `values` is a
+         dict for all, or a list of dicts, one per camera. If one camera rejects
+         its values, the others are set back, so the group stays consistent.
+       get_controls(*keys, ids=None) : list of {key: value}, see `Camera.get_controls`
+       align_phase(tolerance=0.001, reference=None, frames=10, attempts=8, monitor=True) :
+         Software genlock: restart the streams of cameras whose frames are out of
+         phase with the `reference` camera (default: the Multicam's), each timed
+         to land on its phase, until all are within `tolerance` seconds. Returns
+         the offsets. With `monitor`, reads keep tracking the offsets and restart
+         a camera that drifts away.
        read(n=None, ids=None) :
          if `n` is not `None`; read `n` frames.
          If `ids` is `None`; read from all cameras.
          Else, `ids` should be an iterable containing the camera indices to read from.
+         Cameras with different output shapes or dtypes (e.g. RGB and Z16, or
+         different sizes without `letterbox`) give a list with one array per camera.
+         Raises `CameraDisconnected` if one of them is unplugged; with
+         `reconnect=True` it comes back on its own and reads can be retried.
          
       Examples
       --------
@@ -134,13 +517,105 @@ class Multicam():
       #Using a context manager:
       with Multicam(["/dev/video0", "/dev/video2"]) as mc:
           data = mc.read()
+      
+      #A 4K MJPEG camera with 720p YUYV cameras, as one (3,720,1280,3) array:
+      with Multicam([0, 2, 4], [(3840,2160), (1280,720), (1280,720)], ["MJPG", "YUYV", "YUYV"],
+                    fps=[30, 60, 60], letterbox="max") as mc:
+          data = mc.read()
+      
+      #Keep going while cameras are unplugged and plugged back in:
+      with Multicam([{"usb_path": "1-2"}, {"usb_path": "1-3"}], reconnect=True) as mc:
+          while True:
+              try:
+                  data = mc.read()
+              except CameraDisconnected as e:
+                  print("Waiting for", e.cameras, mc.states)
     '''
-    def __init__(self, devs, size=(640,480), format="MJPG", fps=30):
+    def __init__(self, devs, size=(640,480), format="MJPG", fps=30, rotation=0, flip=None, remap=None,
+                 demosaic="bilinear", layout="nhwc", dtype=np.uint8, mean=None, std=None, scale=None, offset=None,
+                 letterbox=None, pad=0, grid=None, tile=None, skip_corrupt=3, stall_timeout=None,
+                 reconnect=False, metadata=False, pairing=False, reference=0, rate=None, latency=None, decimate=1,
+                 continuous=False, queue_size=4, backpressure="drop_oldest", keep_every=2):
         self.devs = devs
         self.size = size
         self.format = format
         self.fps = fps
+        self.rotation = rotation
+        self.flip = flip
+        self.remap = remap
+        self.demosaic = demosaic
+        self.layout = layout
+        self.dtype = dtype
+        self.mean = mean
+        self.std = std
+        self.scale = scale
+        self.offset = offset
+        self.letterbox = letterbox
+        self.pad = pad
+        self.grid = grid
+        self.tile = tile
+        self.skip_corrupt = skip_corrupt
+        self.stall_timeout = stall_timeout
+        self.reconnect = reconnect
+        self.metadata = metadata
+        self.decimate = decimate
+        self.pairing = pairing
+        self.reference = reference
+        self.rate = rate
+        self.latency = latency
+        self.continuous = continuous
+        self.queue_size = queue_size
+        self.backpressure = backpressure
+        self.keep_every = keep_every
+        self.tick = None
+        self.schedule_stats = None
         self.cameras = []
+        self._tick = None      #Schedule of reads with `rate`
+        self._queues = []      #CaptureQueue per camera with `continuous`
+        self._taken = {}       #CapturedFrame last taken from each queue
+        self._lock = threading.RLock()
+        self._supervisor = None
+        self._phase = None     #PhaseTracker while align_phase monitors
+        self._clocks = []      #ClockModel per camera
+        self._output = self._output_kwargs()
+    
+    def _output_kwargs(self):
+        dtype = np.dtype(self.dtype).name
+        scale, offset = self.scale, self.offset
+        if self.mean is not None or self.std is not None:
+            if scale is not None or offset is not None:
+                raise ValueError("Give either `mean`/`std` or `scale`/`offset`, not both.")
+            mean = np.broadcast_to(np.asarray(0.0 if self.mean is None else self.mean, np.float64), 3)
+            std = np.broadcast_to(np.asarray(1.0 if self.std is None else self.std, np.float64), 3)
+            scale, offset = 1.0/(255.0*std), -mean/std
+        elif dtype != "uint8" and scale is None:
+            scale = 1.0/255.0
+        if dtype == "uint8" and (scale is not None or offset is not None):
+            raise ValueError("Normalization requires a float dtype.")
+        def triple(v): return None if v is None else tuple(float(x) for x in np.broadcast_to(v, 3))
+        letterbox, grid = self.letterbox, None
+        if self.layout == "grid":
+            if letterbox is not None: raise ValueError("Use `tile` to size grid tiles.")
+            letterbox = self.tile
+            grid = self.grid
+            if grid is None:
+                cols = int(np.ceil(np.sqrt(len(self.devs))))
+                grid = (int(np.ceil(len(self.devs)/cols)), cols)
+            grid = tuple(grid)
+        elif self.tile is not None or self.grid is not None:
+            raise ValueError("`grid` and `tile` require layout 'grid'.")
+        if isinstance(letterbox, str):
+            if letterbox != "max": raise ValueError(f"Invalid letterbox size '{letterbox}'.")
+        elif letterbox is not None:
+            letterbox = tuple(letterbox)
+        return dict(layout=self.layout, dtype=dtype, scale=triple(scale), offset=triple(offset),
+                    letterbox=letterbox, pad=self.pad, grid=grid)
+    
+    def _resolve_letterbox(self):
+        #"max": the largest output of the started cameras, known only once they are configured
+        if self._output["letterbox"] == "max":
+            sizes = [(c._v4l2cam.out_width, c._v4l2cam.out_height) for c in self.cameras]
+            self._output["letterbox"] = (max(w for w, _ in sizes), max(h for _, h in sizes))
     
     @property
     def width(self): return self.size[0]
@@ -149,33 +624,284 @@ class Multicam():
     
     @property
     def started(self):
-        return all([c.started for c in self.cameras])
+        return all([c.started or c.state == "disconnected" for c in self.cameras])
+    
+    @property
+    def states(self): return [c.state for c in self.cameras]
+    
+    @property
+    def frame_stats(self): return [c.frame_stats for c in self.cameras]
+    
+    @property
+    def timestamps(self):
+        if self._queues: return [getattr(self._taken.get(i), "timestamp", None) for i in range(len(self.cameras))]
+        return [c.timestamp for c in self.cameras]
+    
+    @property
+    def hw_timestamps(self):
+        if self._queues: return [getattr(self._taken.get(i), "hw_timestamp", None) for i in range(len(self.cameras))]
+        return [c.hw_timestamp for c in self.cameras]
+    
+    @property
+    def queue_stats(self): return ([q.stats for q in self._queues] if self._queues else None)
+    
+    @property
+    def drift(self):
+        return (drift_report(self._clocks, self.reference) if self._clocks else None)
+    
+    @property
+    def pairing_errors(self):
+        times = self._frame_times()
+        ref = (times[self.reference] if times else None)
+        return [(None if t is None or ref is None else t - ref) for t in times]
+    
+    @property
+    def phase_offsets(self): return (None if self._phase is None else list(self._phase.offsets))
        
     def start(self):
         try:
-            for dev in self.devs:
-                cam = Camera(dev, self.size, self.format, self.fps)
-                cam.start()
-                self.cameras.append(cam)
+            rotations = _per_camera(self.rotation, len(self.devs), "rotation")
+            flips = _per_camera(self.flip, len(self.devs), "flip")
+            remaps = ([None] * len(self.devs) if self.remap is None else self.remap)
+            if len(remaps) != len(self.devs):
+                raise ValueError(f"Expected {len(self.devs)} values for `remap`, got {len(remaps)}.")
+            demosaics = _per_camera(self.demosaic, len(self.devs), "demosaic")
+            formats = _per_camera(self.format, len(self.devs), "format")
+            sizes = (_per_camera(self.size, len(self.devs), "size") if isinstance(self.size[0], (list, tuple))
+                     else [self.size] * len(self.devs))
+            fpss = _per_camera(self.fps, len(self.devs), "fps")
+            skips = _per_camera(self.skip_corrupt, len(self.devs), "skip_corrupt")
+            stalls = _per_camera(self.stall_timeout, len(self.devs), "stall_timeout")
+            metas = _per_camera(self.metadata, len(self.devs), "metadata")
+            decimates = _per_camera(self.decimate, len(self.devs), "decimate")
+            cameras = []
+            for dev, size, format, fps, rotation, flip, remap, demosaic, skip, stall, meta, decimate in zip(
+                    self.devs, sizes, formats, fpss, rotations, flips, remaps, demosaics, skips, stalls, metas,
+                    decimates):
+                cam = Camera(dev, size, format, fps, rotation, flip, remap, demosaic, skip_corrupt=skip,
+                             stall_timeout=stall, metadata=meta, decimate=decimate)
+                cam._lock = self._lock #Reconnection swaps cameras only between reads
+                cam._configure()
+                cameras.append(cam)
+            #Opens and starts all devices concurrently; none are left running on failure
+            if cameras: camsys_start([cam._v4l2cam for cam in cameras])
+            for cam in cameras: cam.state = "connected"
+            self.cameras = cameras
+            self._clocks = [ClockModel(1/cam.fps) for cam in cameras]
+            self.tick = self._tick = None
+            self.schedule_stats = dict(ticks=0, missed=0, duplicated=[0] * len(cameras), dropped=[0] * len(cameras))
+            self._output = self._output_kwargs()
+            self._resolve_letterbox()
+            if self.continuous: self._start_capture()
+            if self.reconnect:
+                self._supervisor = HotplugSupervisor(self.cameras)
+                self._supervisor.start()
         except Exception as e:
             self.stop()
             raise e
                
+    def _start_capture(self):
+        if self.rate or self.pairing or self.layout == "grid":
+            raise ValueError("Continuous capture does not combine with `rate`, `pairing` or layout 'grid'.")
+        n = len(self.cameras)
+        sizes = _per_camera(self.queue_size, n, "queue_size")
+        policies = _per_camera(self.backpressure, n, "backpressure")
+        self._taken = {}
+        self._queues = [CaptureQueue(self, i, size, policy, self.keep_every)
+                        for i, (size, policy) in enumerate(zip(sizes, policies))]
+        for cam, q in zip(self.cameras, self._queues): cam._capture = q
+        for q in self._queues: q.start()
+    
     def stop(self):
+        queues, self._queues = self._queues, []
         try:
-            for cam in self.cameras: cam.stop()
+            for q in queues: q.stop()
+            if self._supervisor is not None: self._supervisor.stop()
+            with self._lock:
+                for cam in self.cameras: cam.stop() #Also ends reads the queues are waiting in
+            for q in queues: q.join(2.0)
+            for cam in self.cameras: cam._capture = None
         finally:
+            self._supervisor = None
+            self._phase = None
+            self._clocks = []
             self.cameras = []     
     
-    def read(self, n=None, ids=None):
-        if self.started:
-            cams = ([self.cameras[i] for i in ids] if ids else self.cameras)
-            if n is not None:
-                return np.stack([camsys_read(self, cams) for _ in range(n)], axis=1)
-            else:
-                return camsys_read(self, cams)
-        else:
+    def pause(self):
+        for q in self._queues: q.paused = True
+        for cam in self.cameras: cam.pause()
+    
+    def resume(self):
+        for cam in self.cameras: cam.resume()
+        for q in self._queues: q.paused = False
+    
+    def _selected(self, ids):
+        #Connected cameras at `ids`; call with the lock held
+        if not self.cameras or not self.started:
             raise RuntimeError("One or more cameras not started.")
+        ids = (list(ids) if ids else list(range(len(self.cameras))))
+        lost = [i for i in ids if self.cameras[i].state != "connected"]
+        if lost: raise CameraDisconnected(lost)
+        return ids, [self.cameras[i] for i in ids]
+    
+    def set_controls(self, values=None, ids=None, **kwargs):
+        with self._lock:
+            ids, cams = self._selected(ids)
+            if isinstance(values, (list, tuple)):
+                if len(values) != len(cams):
+                    raise ValueError(f"Expected control values for {len(cams)} cameras, got {len(values)}.")
+                values = [{**v, **kwargs} for v in values]
+            else:
+                values = [{**(values or {}), **kwargs}] * len(cams)
+            controls = [encode_controls(c.controls, v) for c, v in zip(cams, values)]
+            camsys_set_controls([c._v4l2cam for c in cams], controls)
+    
+    def get_controls(self, *keys, ids=None):
+        with self._lock:
+            ids, cams = self._selected(ids)
+            return [c.get_controls(*keys) for c in cams]
+    
+    def _frame_times(self):
+        #Capture time of each camera's last frame, from the device clock if known
+        return [(h if h is not None else t) for h, t in zip(self.hw_timestamps, self.timestamps)]
+    
+    def _restart_in_phase(self, tracker, i):
+        #Stop camera `i` and restart it when its first frame lands on the reference phase
+        cam = self.cameras[i]
+        cam.pause()
+        t = tracker.restart_time(i, time.monotonic() + 0.002)
+        time.sleep(max(t - time.monotonic(), 0))
+        tracker.restarted(i, time.monotonic())
+        cam.resume()
+    
+    def _measure_phase(self, tracker, frames):
+        samples = []
+        for _ in range(frames):
+            camsys_read(self, self.cameras, **self._output)
+            samples.append(self._frame_times())
+        tracker.measure(samples)
+    
+    def _track_phase(self, ids):
+        #Follow the phase offsets after align_phase; restart cameras that drift off
+        tracker = self._phase
+        if tracker is None or tracker.reference not in ids: return
+        times = self._frame_times()
+        tracker.update([(t if i in ids else None) for i, t in enumerate(times)])
+        for i in tracker.misaligned(): self._restart_in_phase(tracker, i)
+    
+    def _pair(self, ids):
+        #Ask each camera for its frame closest to the reference's latest one. Older
+        #queued frames of the reference may have been dropped by the driver already.
+        lead = (self.reference if self.reference in ids else ids[0])
+        clock = self._clocks[lead]
+        if not clock.ready: return
+        t = clock.predict(max(clock.last[0] + 1, clock.sequence_at(time.monotonic()) - 1))
+        for i in ids:
+            c = self._clocks[i]
+            if not c.ready: continue
+            self.cameras[i]._v4l2cam.next_sequence = max(c.sequence_at(t), c.last[0] + 1)
+    
+    def _schedule(self, ids):
+        #Wait for the next tick, then ask each camera for its frame closest to it
+        period = 1/self.rate
+        stats = self.schedule_stats
+        now = time.monotonic()
+        tick = (now + period if self._tick is None else self._tick + period)
+        if tick < now: #Reads came too late; skip the ticks missed
+            missed = int((now - tick)/period) + 1
+            stats["missed"] += missed
+            tick += missed * period
+        time.sleep(max(tick - now, 0))
+        stats["ticks"] += 1
+        self._tick = tick
+        self.tick = t = tick - self._latency()
+        for i in ids:
+            c, v = self._clocks[i], self.cameras[i]._v4l2cam
+            v.keep_last = 1
+            if not c.ready: continue
+            seq, last = c.sequence_at(t), c.last[0]
+            if seq <= last:
+                v.repeat = 1
+                stats["duplicated"][i] += 1
+            else:
+                v.next_sequence = seq
+                #Frames decimation keeps (multiples of decimate) skipped before the one read
+                d = self.cameras[i].decimate
+                stats["dropped"][i] += (seq - 1)//d - last//d
+    
+    def _latency(self):
+        if self.latency is not None: return self.latency
+        return 1.5 / min(cam.fps / cam.decimate for cam in self.cameras)
+    
+    def _take(self, ids):
+        #Oldest queued frame of each camera, with continuous capture
+        taken, lost = {}, []
+        for k, i in enumerate(ids):
+            try:
+                taken[i] = self._queues[i].get()
+            except DeviceLost:
+                lost.append(k)
+        if lost: raise DeviceLost("Camera disconnected", lost)
+        self._taken.update(taken)
+        for i, f in taken.items():
+            t = (f.hw_timestamp if f.hw_timestamp is not None else f.timestamp)
+            if t is not None and f.sequence is not None: self._clocks[i].update(f.sequence, t)
+        images = [taken[i].image for i in ids]
+        if all(a.shape == images[0].shape and a.dtype == images[0].dtype for a in images):
+            return np.stack(images)
+        return images
+    
+    def _read_once(self, ids, cams):
+        if self._queues: return self._take(ids)
+        if self.rate: self._schedule(ids)
+        elif self.pairing: self._pair(ids)
+        frames = camsys_read(self, cams, **self._output)
+        for i in ids:
+            cam, c = self.cameras[i], self._clocks[i]
+            t = (cam.hw_timestamp if cam.hw_timestamp is not None else cam.timestamp)
+            if t is not None and not (c.last is not None and cam.sequence == c.last[0]): #Not repeated
+                c.update(cam.sequence, t)
+        return frames
+    
+    def align_phase(self, tolerance=0.001, reference=None, frames=10, attempts=8, monitor=True):
+        with self._lock:
+            if reference is None: reference = self.reference
+            if self._queues: raise ValueError("Phase alignment needs reads of its own; not with continuous capture.")
+            _, cams = self._selected(None)
+            fps = [c.fps for c in cams]
+            if any(abs(f - fps[reference]) > 0.005*fps[reference] for f in fps):
+                raise ValueError("Phase alignment needs all cameras at the same frame rate.")
+            self._phase = None
+            tracker = PhaseTracker(len(cams), reference, 1/fps[reference], tolerance)
+            self._measure_phase(tracker, frames)
+            for _ in range(attempts):
+                late = tracker.misaligned()
+                if not late: break
+                for i in late: self._restart_in_phase(tracker, i)
+                self._measure_phase(tracker, frames)
+            if monitor: self._phase = tracker
+            return list(tracker.offsets)
+    
+    def read(self, n=None, ids=None):
+        with self._lock:
+            ids, cams = self._selected(ids)
+            try:
+                if n is not None:
+                    frames = [self._read_once(ids, cams) for _ in range(n)]
+                    self._track_phase(ids)
+                    if isinstance(frames[0], list): #Mixed outputs: one stack per camera
+                        return [np.stack(f) for f in zip(*frames)]
+                    axis = (0 if self.layout == "grid" else 1)
+                    return np.stack(frames, axis=axis)
+                else:
+                    frames = self._read_once(ids, cams)
+                    self._track_phase(ids)
+                    return frames
+            except DeviceLost as e:
+                lost = [ids[i] for i in e.args[1]]
+                for i in lost: self.cameras[i]._lost()
+        if self._supervisor is not None: self._supervisor.notify()
+        raise CameraDisconnected(lost)
     
     def __enter__(self):
         self.start()
@@ -185,6 +911,69 @@ class Multicam():
         
     def __del__(self): self.stop()
     
-def list_cams():
-    return sorted([p for p in Path("/dev/").glob("video*") if is_valid_device(p)])
+def _control(controls, key):
+    ctrl = controls.get(key) or next((c for c in controls.values() if c.name == key), None)
+    if ctrl is None: raise ValueError(f"No control '{key}'; available: {', '.join(controls)}.")
+    if not ctrl.readable: raise ValueError(f"Control '{key}' cannot be read.")
+    return ctrl
+
+def _per_camera(value, n, name):
+    if isinstance(value, (list, tuple)):
+        if len(value) != n: raise ValueError(f"Expected {n} values for `{name}`, got {len(value)}.")
+        return list(value)
+    return [value] * n
+
+def choose_format(caps, size, fps):
+    '''
+      Pick the capture format that is cheapest to convert to RGB among those
+      offering `size` at `fps`, from a device's `Capabilities` and `FORMAT_COST`.
+      Only the modes needed for the decision are enumerated.
+      Small uncompressed frames usually win (YUYV at 640x480); where the bus
+      only carries them at low rates, MJPG does (1080p at 30 fps over USB 2).
+      
+      Returns
+      -------
+       (fourcc, reason) : The format, and a string explaining the choice.
+    '''
+    size = tuple(size)
+    candidates, rejected = [], []
+    for name, info in caps.formats().items():
+        if name not in FORMAT_COST:
+            rejected.append(f"{name}: not supported")
+            continue
+        if not caps.supports(name, size):
+            rejected.append(f"{name}: no {size[0]}x{size[1]}")
+            continue
+        if not caps.supports(name, size, fps):
+            rates = caps.rates(name, size)
+            rates = (f"{rates.min_fps:g}-{rates.max_fps:g}" if isinstance(rates, RateRange)
+                     else ', '.join(f'{r:g}' for r in sorted(set(rates))))
+            rejected.append(f"{name}: {size[0]}x{size[1]} only at {rates} fps")
+            continue
+        cost = FORMAT_COST[name] + (EMULATED_COST if info.emulated else 0.0)
+        candidates.append((cost, name))
+    if not candidates:
+        raise ValueError(f"No usable format for {size[0]}x{size[1]} at {fps:g} fps ({'; '.join(rejected)}).")
+    candidates.sort()
+    cost, name = candidates[0]
+    ms = cost * size[0] * size[1] * 1e-6
+    reason = f"{name} at {size[0]}x{size[1]}@{fps:g}: cheapest to convert, ~{ms:.1f} ms/frame ({ms*fps/10:.1f}% of a core)"
+    others = [f"{n} ~{c * size[0] * size[1] * 1e-6:.1f} ms" for c, n in candidates[1:]]
+    if others: reason += "; also possible: " + ", ".join(others)
+    if rejected: reason += "; ruled out: " + "; ".join(rejected)
+    return name, reason
+
+def list_cams(verify=False):
+    '''
+      Capture device paths, from the sysfs discovery cache (see `discover`).
+      Nodes that udev records as not capturing video (metadata, codec and
+      output nodes) are left out without opening them; nodes udev has no
+      record of are opened and checked, as are all nodes if `verify` is set.
+      Without sysfs, all /dev/video* nodes are checked.
+    '''
+    devices = discover()
+    if not devices and not sysfs_available():
+        return sorted([p for p in Path("/dev/").glob("video*") if is_valid_device(p)])
+    return [d.path for d in devices if d.is_capture is not False
+            and ((d.is_capture and not verify) or is_valid_device(d.path))]
 
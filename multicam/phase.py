@@ -0,0 +1,119 @@
+'''
+  Software genlock: phase alignment of free-running cameras.
+
+  Cameras at the same nominal rate run on their own clocks, so their frames
+  are offset by a random phase of up to half a frame interval. That phase is
+  fixed when a camera starts streaming, so a camera can be moved onto the
+  reference camera's phase by stopping it and issuing STREAMON at the right
+  moment. The delay from STREAMON to the first exposure is not known up
+  front, but it is steady enough per camera to be learned (modulo the frame
+  interval) from the previous restart and corrected for on the next.
+
+  Nudging the frame interval with S_PARM instead is not an option for UVC
+  cameras: uvcvideo refuses S_PARM while streaming, so a changed interval
+  needs a restart anyway.
+'''
+import math
+
+__all__ = ["PhaseTracker", "wrap", "circular_mean"]
+
+def wrap(dt, period):
+    '''`dt` folded into [-period/2, period/2).'''
+    return (dt + period/2) % period - period/2
+
+def circular_mean(offsets, period):
+    '''Mean of phase offsets, taken on the circle so -period/2 and period/2 agree.'''
+    a = [2*math.pi*o/period for o in offsets]
+    return period/(2*math.pi) * math.atan2(sum(map(math.sin, a)), sum(map(math.cos, a)))
+
+class PhaseTracker():
+    '''
+      Phase offsets of cameras to a reference camera, from capture times.
+
+      Parameters
+      ----------
+       n : int
+         Number of cameras.
+       reference : int
+         Index of the camera the others are aligned to.
+       period : float
+         Nominal frame interval in seconds; refined from the reference
+         camera's timestamps as they come in.
+       tolerance : float
+         Largest offset in seconds counted as aligned.
+       smoothing : float
+         Weight of a new sample in the running offsets of `update`.
+    '''
+    def __init__(self, n, reference, period, tolerance, smoothing=0.1):
+        self.reference = reference
+        self.nominal = period
+        self.period = period
+        self.tolerance = tolerance
+        self.smoothing = smoothing
+        self.offsets = [None] * n
+        self.latency = [None] * n  #STREAMON to mid-exposure of a frame, modulo the period
+        self.issued = [None] * n   #Time of a restart not yet measured
+        self._last = None          #Latest reference timestamp
+        self._span = [0.0, 0]      #Reference time and frame intervals seen
+
+    def _reference(self, times):
+        #Track the reference and refine the period; returns its timestamp
+        ref = times[self.reference]
+        if ref is None: return None
+        if self._last is not None and ref > self._last:
+            k = round((ref - self._last)/self.nominal)
+            if k > 0:
+                self._span[0] += ref - self._last
+                self._span[1] += k
+                self.period = self._span[0]/self._span[1]
+        self._last = ref
+        return ref
+
+    def _learn(self, i, offset):
+        #Latency of the restart of camera `i`, given its first offset since
+        observed = wrap(self._last + offset - self.issued[i], self.period)
+        lat = self.latency[i]
+        self.latency[i] = (observed if lat is None else lat + 0.5*wrap(observed - lat, self.period))
+        self.issued[i] = None
+
+    def measure(self, samples):
+        '''
+          Sets the offsets to the circular mean over `samples`, a list of
+          per-camera capture times (None where unknown) of consecutive reads.
+        '''
+        diffs = [[] for _ in self.offsets]
+        for times in samples:
+            ref = self._reference(times)
+            if ref is None: continue
+            for i, t in enumerate(times):
+                if t is not None: diffs[i].append(wrap(t - ref, self.period))
+        for i, d in enumerate(diffs):
+            if not d: continue
+            self.offsets[i] = (0.0 if i == self.reference else circular_mean(d, self.period))
+            if self.issued[i] is not None: self._learn(i, self.offsets[i])
+
+    def update(self, times):
+        '''Running offsets from the capture times of one read.'''
+        ref = self._reference(times)
+        if ref is None: return
+        for i, t in enumerate(times):
+            if t is None or i == self.reference: continue
+            d = wrap(t - ref, self.period)
+            if self.issued[i] is not None: self._learn(i, d)
+            o = self.offsets[i]
+            self.offsets[i] = (d if o is None else wrap(o + self.smoothing*wrap(d - o, self.period), self.period))
+        self.offsets[self.reference] = 0.0
+
+    def misaligned(self):
+        '''Cameras whose offset exceeds the tolerance.'''
+        return [i for i, o in enumerate(self.offsets) if o is not None and abs(o) > self.tolerance]
+
+    def restart_time(self, i, now):
+        '''First time after `now` at which STREAMON puts camera `i` on the reference's phase.'''
+        target = self._last - (self.latency[i] or 0.0)
+        return now + (target - now) % self.period
+
+    def restarted(self, i, t):
+        '''Records that camera `i` was restarted at `t`; its next offset teaches the latency.'''
+        self.issued[i] = t
+        self.offsets[i] = None
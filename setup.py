@@ -11,7 +11,7 @@ backend = Extension('multicam.backend',
     include_dirs  = ['libyuv/include'],
     libraries     = [':libyuv.a', ':libjpeg.so.8', 'stdc++'],
     library_dirs  = ['libyuv/out'],
-    sources       = ['src/multicam.c', 'src/v4l2.c'],
+    sources       = ['src/multicam.c', 'src/v4l2.c', 'src/convert.c', 'src/remap.c', 'src/bayer.c', 'src/unpack.c', 'src/watchdog.c', 'src/uvcmeta.c'],
     extra_compile_args = [],
     extra_link_args    = [],
 )
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <linux/videodev2.h>
+#include "bayer.h"
+
+/*
+ * Demosaicing of 8-bit Bayer frames to ARGB, which libyuv no longer supports.
+ * Interior pixels are computed in place with fixed offsets, two pixels (one of
+ * each site type of the row) per step. Pixels within two of the border use
+ * the same kernels on a 5x5 patch reflected about the edge, which keeps the
+ * colour filter phase.
+*/
+
+/* Site types: red, green on a red row, green on a blue row, blue */
+#define SITE_R  0
+#define SITE_GR 1
+#define SITE_GB 2
+#define SITE_B  3
+
+int bayer_pattern(uint32_t fourcc)
+{
+    switch (fourcc) {
+        case V4L2_PIX_FMT_SRGGB8: return BAYER_RGGB;
+        case V4L2_PIX_FMT_SGRBG8: return BAYER_GRBG;
+        case V4L2_PIX_FMT_SGBRG8: return BAYER_GBRG;
+        case V4L2_PIX_FMT_SBGGR8:
+        case v4l2_fourcc('B', 'G', 'G', 'R'): return BAYER_BGGR; //Alias for 'BA81'
+        default: return -1;
+    }
+}
+
+int demosaic_algorithm(const char *name)
+{
+    if (!strcasecmp(name, "nearest")) return DEMOSAIC_NEAREST;
+    if (!strcasecmp(name, "bilinear")) return DEMOSAIC_BILINEAR;
+    if (!strcasecmp(name, "edge")) return DEMOSAIC_EDGE;
+    if (!strcasecmp(name, "raw")) return DEMOSAIC_RAW;
+    return -1;
+}
+
+static inline uint8_t clamp8(int v) { return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+static inline int reflect(int i, int n)
+{
+    if (i < 0) return -i;
+    if (i >= n) return 2*n - 2 - i;
+    return i;
+}
+
+static inline int site(int x, int y, int pattern)
+{
+    int rx = pattern & 1, ry = pattern >> 1;
+    if ((y & 1) == ry) return ((x & 1) == rx ? SITE_R : SITE_GR);
+    return ((x & 1) != rx ? SITE_B : SITE_GB);
+}
+
+/* 5x5 neighbourhood of (x,y), reflected at the borders */
+static void
+patch5(const uint8_t *src, int stride, int width, int height, int x, int y, uint8_t *out)
+{
+    for (int j=-2; j<=2; j++) {
+        const uint8_t *row = src + (ptrdiff_t) reflect(y+j, height)*stride;
+        for (int i=-2; i<=2; i++)
+            out[(j+2)*5 + i+2] = row[reflect(x+i, width)];
+    }
+}
+
+static inline void
+put_argb(uint8_t *d, int r, int g, int b)
+{
+    d[0] = clamp8(b);
+    d[1] = clamp8(g);
+    d[2] = clamp8(r);
+    d[3] = 255;
+}
+
+/* Bilinear interpolation at p, a pixel of type t */
+static inline void
+bilinear_px(const uint8_t *p, ptrdiff_t s, int t, uint8_t *d)
+{
+    int c = p[0];
+    int cross = (p[-1] + p[1] + p[-s] + p[s] + 2) >> 2;
+    int diag = (p[-s-1] + p[-s+1] + p[s-1] + p[s+1] + 2) >> 2;
+    int hor = (p[-1] + p[1] + 1) >> 1;
+    int ver = (p[-s] + p[s] + 1) >> 1;
+    switch (t) {
+        case SITE_R:  put_argb(d, c, cross, diag); break;
+        case SITE_GR: put_argb(d, hor, c, ver); break;
+        case SITE_GB: put_argb(d, ver, c, hor); break;
+        default:      put_argb(d, diag, cross, c); break;
+    }
+}
+
+/* Green at a red or blue site, interpolated along the direction with the smaller gradient */
+static inline uint8_t
+edge_green(const uint8_t *p, ptrdiff_t s)
+{
+    int c2 = 2*p[0];
+    int lap_h = c2 - p[-2] - p[2], lap_v = c2 - p[-2*s] - p[2*s];
+    int grad_h = abs(p[-1] - p[1]) + abs(lap_h);
+    int grad_v = abs(p[-s] - p[s]) + abs(lap_v);
+    int g_h = 2*(p[-1] + p[1]) + lap_h;
+    int g_v = 2*(p[-s] + p[s]) + lap_v;
+    int g = (grad_h < grad_v ? g_h : (grad_v < grad_h ? g_v : (g_h + g_v + 1) >> 1));
+    return clamp8((g + 2) >> 2);
+}
+
+/* Red and blue from colour differences against the full green plane q */
+static inline void
+edge_px(const uint8_t *p, ptrdiff_t s, const uint8_t *q, ptrdiff_t qs, int t, uint8_t *d)
+{
+    int g = q[0];
+    int hor = ((p[-1] - q[-1]) + (p[1] - q[1])) / 2;
+    int ver = ((p[-s] - q[-qs]) + (p[s] - q[qs])) / 2;
+    int diag = ((p[-s-1] - q[-qs-1]) + (p[-s+1] - q[-qs+1]) + (p[s-1] - q[qs-1]) + (p[s+1] - q[qs+1])) / 4;
+    switch (t) {
+        case SITE_R:  put_argb(d, p[0], g, g + diag); break;
+        case SITE_GR: put_argb(d, g + hor, g, g + ver); break;
+        case SITE_GB: put_argb(d, g + ver, g, g + hor); break;
+        default:      put_argb(d, g + diag, g, p[0]); break;
+    }
+}
+
+static void
+demosaic_nearest(const uint8_t *src, int src_stride, int width, int height, int pattern, uint8_t *dst, int dst_stride)
+{
+    int rx = pattern & 1, ry = pattern >> 1;
+    for (int y=0; y+1<height; y+=2) {
+        const uint8_t *s0 = src + (ptrdiff_t) y*src_stride, *s1 = s0 + src_stride;
+        const uint8_t *rrow = (ry ? s1 : s0), *brow = (ry ? s0 : s1);
+        uint8_t *d0 = dst + (ptrdiff_t) y*dst_stride, *d1 = d0 + dst_stride;
+        for (int x=0; x+1<width; x+=2) {
+            int r = rrow[x+rx], b = brow[x+1-rx];
+            int g0 = rrow[x+1-rx], g1 = brow[x+rx];
+            int g = (g0 + g1 + 1) >> 1;
+            uint8_t *dr = (ry ? d1 : d0), *db = (ry ? d0 : d1);
+            put_argb(dr + (x+rx)*4, r, g, b);
+            put_argb(dr + (x+1-rx)*4, r, g0, b);
+            put_argb(db + (x+rx)*4, r, g1, b);
+            put_argb(db + (x+1-rx)*4, r, g, b);
+        }
+    }
+}
+
+static void
+fill_green(const uint8_t *src, int src_stride, int width, int height, int pattern, uint8_t *green)
+{
+    uint8_t patch[25];
+    for (int y=0; y<height; y++) {
+        const uint8_t *row = src + (ptrdiff_t) y*src_stride;
+        uint8_t *g = green + (ptrdiff_t) y*width;
+        int interior = (y >= 2 && y < height-2);
+        for (int x=0; x<width; x++) {
+            int t = site(x, y, pattern);
+            if (t == SITE_GR || t == SITE_GB)
+                g[x] = row[x];
+            else if (interior && x >= 2 && x < width-2)
+                g[x] = edge_green(row + x, src_stride);
+            else {
+                patch5(src, src_stride, width, height, x, y, patch);
+                g[x] = edge_green(patch + 12, 5);
+            }
+        }
+    }
+}
+
+int demosaic_to_argb(const uint8_t *src, int src_stride, int width, int height, int pattern, int algorithm,
+                     uint8_t *dst, int dst_stride, uint8_t *green)
+{
+    uint8_t patch[25], gpatch[25];
+    if (width < 2 || height < 2 || (width & 1) || (height & 1) || pattern < 0)
+        return -1;
+    if (algorithm == DEMOSAIC_NEAREST) {
+        demosaic_nearest(src, src_stride, width, height, pattern, dst, dst_stride);
+        return 0;
+    }
+    if (algorithm == DEMOSAIC_EDGE) {
+        if (!green) return -1;
+        fill_green(src, src_stride, width, height, pattern, green);
+    }
+    else if (algorithm != DEMOSAIC_BILINEAR)
+        return -1;
+
+    for (int y=0; y<height; y++) {
+        const uint8_t *row = src + (ptrdiff_t) y*src_stride;
+        const uint8_t *grow = (green ? green + (ptrdiff_t) y*width : NULL);
+        uint8_t *d = dst + (ptrdiff_t) y*dst_stride;
+        int interior = (y >= 2 && y < height-2);
+        int t0 = site(0, y, pattern), t1 = site(1, y, pattern);
+        for (int x=0; x<width; x++) {
+            int t = (x & 1 ? t1 : t0);
+            if (interior && x == 2 && width >= 6) { //Fast path over the interior, two sites per step
+                for (; x+1 < width-2; x+=2) {
+                    if (algorithm == DEMOSAIC_EDGE) {
+                        edge_px(row + x, src_stride, grow + x, width, t0, d + x*4);
+                        edge_px(row + x+1, src_stride, grow + x+1, width, t1, d + x*4+4);
+                    }
+                    else {
+                        bilinear_px(row + x, src_stride, t0, d + x*4);
+                        bilinear_px(row + x+1, src_stride, t1, d + x*4+4);
+                    }
+                }
+                x--;
+                continue;
+            }
+            patch5(src, src_stride, width, height, x, y, patch);
+            if (algorithm == DEMOSAIC_EDGE) {
+                patch5(green, width, width, height, x, y, gpatch);
+                edge_px(patch + 12, 5, gpatch + 12, 5, t, d + x*4);
+            }
+            else
+                bilinear_px(patch + 12, 5, t, d + x*4);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef BAYER_H
+#define BAYER_H
+#include <stdint.h>
+#include <stddef.h>
+
+/* Demosaic algorithms */
+#define DEMOSAIC_NEAREST  0
+#define DEMOSAIC_BILINEAR 1
+#define DEMOSAIC_EDGE     2 /* Hamilton-Adams style, edge-directed green */
+#define DEMOSAIC_RAW      3 /* No demosaic; output the mosaic as is */
+
+/* Patterns, encoded as the position of the red pixel in each 2x2 block */
+#define BAYER_RGGB 0
+#define BAYER_GRBG 1
+#define BAYER_GBRG 2
+#define BAYER_BGGR 3
+
+int bayer_pattern(uint32_t fourcc);
+int demosaic_algorithm(const char *name);
+int demosaic_to_argb(const uint8_t *src, int src_stride, int width, int height, int pattern, int algorithm,
+                     uint8_t *dst, int dst_stride, uint8_t *green);
+#endif //BAYER_H
@@ -0,0 +1,428 @@
+#include <Python.h>
+#include <math.h>
+#include <linux/videodev2.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_F16C_KERNELS
+#endif
+#include "libyuv.h"
+#include "convert.h"
+#include "remap.h"
+
+/*
+ * Conversion of a captured sample to ARGB, with libyuv or the Bayer demosaic.
+*/
+/* Whether a frame holds a whole image. JPEG frames need SOI at the start and
+   EOI at the end (zero padding aside), since libjpeg decodes a truncated frame
+   without error, filling the rest with grey. Raw frames need the size agreed
+   with VIDIOC_S_FMT. */
+int frame_is_complete(v4l2camObject *cam, const uint8_t *sample, size_t bytesused)
+{
+    if (cam->fourcc == V4L2_PIX_FMT_MJPEG || cam->fourcc == V4L2_PIX_FMT_JPEG) {
+        if (bytesused < 4 || sample[0] != 0xFF || sample[1] != 0xD8) return 0;
+        while (bytesused > 4 && sample[bytesused-1] == 0) bytesused--;
+        return (sample[bytesused-2] == 0xFF && sample[bytesused-1] == 0xD9);
+    }
+    return (bytesused >= cam->sizeimage);
+}
+
+int convert_frame(v4l2camObject *cam, const uint8_t *sample, size_t sample_size, int rotation, uint8_t *argb)
+{
+    if (cam->bayer < 0)
+        return ConvertToARGB(sample, sample_size,
+                             argb, cam->out_width*4, //dst, dst_stride
+                             0, 0, //crop_x, crop_y
+                             cam->width, cam->height,
+                             cam->width, cam->height,
+                             (enum RotationMode) rotation, //RotationMode
+                             cam->fourcc); //FOURCC
+
+    int stride = (cam->bytesperline > 0 ? cam->bytesperline : cam->width);
+    if (sample_size < (size_t) stride * (cam->height-1) + cam->width)
+        return -1;
+    uint8_t *green = NULL;
+    if (cam->demosaic == DEMOSAIC_EDGE) {
+        green = scratch_reserve(&cam->green, (size_t) cam->width * cam->height);
+        if (!green) return -1;
+    }
+    if (rotation == 0)
+        return demosaic_to_argb(sample, stride, cam->width, cam->height, cam->bayer, cam->demosaic,
+                                argb, cam->width*4, green);
+    uint8_t *rotated = scratch_reserve(&cam->rotated, (size_t) cam->width * cam->height * 4);
+    if (!rotated) return -1;
+    int res = demosaic_to_argb(sample, stride, cam->width, cam->height, cam->bayer, cam->demosaic,
+                               rotated, cam->width*4, green);
+    if (res != 0) return res;
+    return ARGBRotate(rotated, cam->width*4, argb, cam->out_width*4, cam->width, cam->height,
+                      (enum RotationMode) rotation);
+}
+
+/* Converts a frame whose planes come in separate buffers (multi-planar
+   formats such as NM12 or YM12) to ARGB. libyuv takes the planes one by one,
+   so rotation goes through the rotated scratch buffer. */
+int convert_planes(v4l2camObject *cam, const struct buffer *planes, int rotation, uint8_t *argb)
+{
+    int w = cam->width, h = cam->height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    const uint8_t *y = planes[0].start, *u = planes[1].start, *v = NULL;
+    int sy = (cam->plane_stride[0] > 0 ? cam->plane_stride[0] : w);
+    int su = cam->plane_stride[1], sv = 0;
+    uint8_t *out = argb;
+    int res;
+
+    if (cam->n_planes > 2) {
+        v = planes[2].start;
+        sv = cam->plane_stride[2];
+    }
+    if (rotation != 0) {
+        out = scratch_reserve(&cam->rotated, (size_t) w * h * 4);
+        if (!out) return -1;
+    }
+    if (planes[0].length < (size_t) sy * (h-1) + w)
+        return -1;
+
+    switch (cam->fourcc) {
+        case V4L2_PIX_FMT_NV12M:
+        case V4L2_PIX_FMT_NV21M:
+            if (su <= 0) su = cw*2;
+            if (planes[1].length < (size_t) su * (ch-1) + cw*2) return -1;
+            res = (cam->fourcc == V4L2_PIX_FMT_NV12M ?
+                   NV12ToARGB(y, sy, u, su, out, w*4, w, h) :
+                   NV21ToARGB(y, sy, u, su, out, w*4, w, h));
+            break;
+        case V4L2_PIX_FMT_YUV420M:
+        case V4L2_PIX_FMT_YVU420M:
+        case V4L2_PIX_FMT_YUV422M:
+            if (!v) return -1;
+            if (cam->fourcc == V4L2_PIX_FMT_YUV422M) ch = h;
+            if (su <= 0) su = cw;
+            if (sv <= 0) sv = cw;
+            if (planes[1].length < (size_t) su * (ch-1) + cw ||
+                planes[2].length < (size_t) sv * (ch-1) + cw) return -1;
+            if (cam->fourcc == V4L2_PIX_FMT_YUV422M)
+                res = I422ToARGB(y, sy, u, su, v, sv, out, w*4, w, h);
+            else if (cam->fourcc == V4L2_PIX_FMT_YUV420M)
+                res = I420ToARGB(y, sy, u, su, v, sv, out, w*4, w, h);
+            else //YVU: second plane is V
+                res = I420ToARGB(y, sy, v, sv, u, su, out, w*4, w, h);
+            break;
+        default:
+            return -1;
+    }
+    if (res != 0 || rotation == 0) return res;
+    return ARGBRotate(out, w*4, argb, cam->out_width*4, w, h, (enum RotationMode) rotation);
+}
+
+/* Writes a single-channel frame to dst: the Bayer mosaic as is, or high bit
+   depth samples unpacked to uint16, rotated and flipped like RGB output */
+int store_raw(v4l2camObject *cam, const uint8_t *sample, size_t sample_size, int rotation, int flip_height, uint8_t *dst)
+{
+    if (cam->mono < 0) {
+        int stride = (cam->bytesperline > 0 ? cam->bytesperline : cam->width);
+        if (sample_size < (size_t) stride * (cam->height-1) + cam->width)
+            return -1;
+        CopyPlane(sample, stride, dst, cam->width, cam->width, cam->height);
+        return 0;
+    }
+    int min_stride = mono16_min_stride(cam->mono, cam->width);
+    int stride = (cam->bytesperline >= min_stride ? cam->bytesperline : min_stride);
+    if (sample_size < (size_t) stride * (cam->height-1) + min_stride)
+        return -1;
+    uint16_t *d = (uint16_t *) dst;
+    int dst_stride = cam->out_width;
+    if (flip_height < 0) {
+        d += (size_t) (cam->out_height-1) * cam->out_width;
+        dst_stride = -dst_stride;
+    }
+    if (rotation == 0) {
+        unpack_mono16(sample, stride, cam->width, cam->height, cam->mono, d, dst_stride);
+        return 0;
+    }
+    uint16_t *unpacked = (uint16_t *) scratch_reserve(&cam->rotated, (size_t) cam->width * cam->height * 2);
+    if (!unpacked) return -1;
+    unpack_mono16(sample, stride, cam->width, cam->height, cam->mono, unpacked, cam->width);
+    RotatePlane_16(unpacked, cam->width, d, dst_stride, cam->width, cam->height, (enum RotationMode) rotation);
+    return 0;
+}
+
+/*
+ * Output stage: takes the ARGB frame produced by convert_frame and writes it
+ * to the output array in the requested layout and dtype, optionally scaled
+ * into a letterbox or a mosaic tile. Each frame is read once from the ARGB
+ * scratch buffer, remapped on the way if the camera has a remap LUT.
+*/
+
+const OutputSpec default_output_spec = {
+    LAYOUT_NHWC, DTYPE_UINT8, {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0, 0, 0, 1, 1
+};
+
+int output_dtype_size(int dtype)
+{
+    switch (dtype) {
+        case DTYPE_FLOAT32: return 4;
+        case DTYPE_FLOAT16: return 2;
+        default: return 1;
+    }
+}
+
+void output_size(v4l2camObject *cam, const OutputSpec *spec, int *width, int *height)
+{
+    if (spec->width > 0 && spec->height > 0) {
+        *width = spec->width;
+        *height = spec->height;
+    }
+    else if (cam->remap) {
+        *width = cam->remap->width;
+        *height = cam->remap->height;
+    }
+    else {
+        *width = cam->out_width;
+        *height = cam->out_height;
+    }
+}
+
+/* Grows a scratch buffer if needed. Buffers are kept between frames. */
+uint8_t *scratch_reserve(struct buffer *b, size_t length)
+{
+    if (b->length < length) {
+        void *p = realloc(b->start, length);
+        if (!p) return NULL;
+        b->start = p;
+        b->length = length;
+    }
+    return (uint8_t *) b->start;
+}
+
+/* IEEE 754 binary32 -> binary16, round to nearest even */
+static inline uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t absx = x & 0x7fffffff;
+    if (absx >= 0x7f800000) //Inf or NaN
+        return sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0);
+    if (absx >= 0x477ff000) //Overflow after rounding
+        return sign | 0x7c00;
+    if (absx < 0x38800000) { //Subnormal or zero
+        if (absx < 0x33000000) return sign;
+        uint32_t mant = (absx & 0x7fffff) | 0x800000;
+        int shift = 126 - (absx >> 23);
+        uint32_t half = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1))) half++;
+        return sign | half;
+    }
+    uint32_t half = (absx - 0x38000000) >> 13;
+    uint32_t rem = absx & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) half++;
+    return sign | half;
+}
+
+#ifdef HAVE_F16C_KERNELS
+/* 8 samples per step; VCVTPS2PH rounds to nearest even, like float_to_half */
+__attribute__((target("avx,f16c"))) static int
+normalize_half_row_f16c(const uint8_t *src, int width, float scale, float offset, uint16_t *d)
+{
+    const __m256 s = _mm256_set1_ps(scale), o = _mm256_set1_ps(offset);
+    int x = 0;
+    for (; x+8 <= width; x+=8) {
+        __m128i b = _mm_loadl_epi64((const __m128i *) (src + x));
+        __m256i i = _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_cvtepu8_epi32(b)),
+                                            _mm_cvtepu8_epi32(_mm_srli_si128(b, 4)), 1);
+        __m256 f = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(i), s), o);
+        _mm_storeu_si128((__m128i *) (d + x), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    return x;
+}
+#endif
+
+/* Splits one ARGB row into R, G, B bytes and normalizes each channel. The
+   float32 loops are contiguous so the compiler vectorizes them; float16 has
+   an F16C kernel, chosen at run time, as float_to_half does not vectorize. */
+static void
+store_row_planar(const uint8_t *argb, int width, const OutputSpec *spec, uint8_t *rgb,
+                 void *dst_r, void *dst_g, void *dst_b)
+{
+    void *dst[3] = {dst_r, dst_g, dst_b};
+#ifdef HAVE_F16C_KERNELS
+    int f16c = (spec->dtype == DTYPE_FLOAT16 && __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"));
+#endif
+    SplitARGBPlane(argb, width*4, rgb, width, rgb + width, width, rgb + 2*width, width, NULL, 0, width, 1);
+    for (int c=0; c<3; c++) {
+        const uint8_t *src = rgb + c*width;
+        const float scale = spec->scale[c], offset = spec->offset[c];
+        if (spec->dtype == DTYPE_FLOAT32) {
+            float *d = dst[c];
+            for (int x=0; x<width; x++)
+                d[x] = src[x]*scale + offset;
+        }
+        else {
+            uint16_t *d = dst[c];
+            int x = 0;
+#ifdef HAVE_F16C_KERNELS
+            if (f16c)
+                x = normalize_half_row_f16c(src, width, scale, offset, d);
+#endif
+            for (; x<width; x++) //Remainder
+                d[x] = float_to_half(src[x]*scale + offset);
+        }
+    }
+}
+
+/* Fills the rectangle [x0,x1)x[y0,y1) of the output with the pad value */
+static void
+fill_rect(const OutputSpec *spec, void *dst, int width, int height, int x0, int y0, int x1, int y1)
+{
+    if (x1 <= x0 || y1 <= y0) return;
+    if (spec->layout != LAYOUT_NCHW) {
+        for (int y=y0; y<y1; y++)
+            memset((uint8_t *) dst + ((size_t) y*width + x0)*3, spec->pad, (size_t) (x1-x0)*3);
+        return;
+    }
+    int elsize = output_dtype_size(spec->dtype);
+    size_t plane = (size_t) width * height;
+    for (int c=0; c<3; c++) {
+        float v = spec->pad*spec->scale[c] + spec->offset[c];
+        uint16_t h = float_to_half(v);
+        for (int y=y0; y<y1; y++) {
+            uint8_t *row = (uint8_t *) dst + (c*plane + (size_t) y*width + x0) * elsize;
+            for (int x=0; x<x1-x0; x++) {
+                if (spec->dtype == DTYPE_FLOAT32) ((float *) row)[x] = v;
+                else if (spec->dtype == DTYPE_FLOAT16) ((uint16_t *) row)[x] = h;
+                else row[x] = spec->pad;
+            }
+        }
+    }
+}
+
+/* Pads the part of tile (tx,ty,tw,th) that lies outside the image (x0,y0,w,h) */
+static void
+fill_border(const OutputSpec *spec, void *dst, int width, int height,
+            int tx, int ty, int tw, int th, int x0, int y0, int w, int h)
+{
+    fill_rect(spec, dst, width, height, tx, ty, tx+tw, y0);
+    fill_rect(spec, dst, width, height, tx, y0+h, tx+tw, ty+th);
+    fill_rect(spec, dst, width, height, tx, y0, x0, y0+h);
+    fill_rect(spec, dst, width, height, x0+w, y0, tx+tw, y0+h);
+}
+
+/* Size of the whole output image of one camera, or of the mosaic in grid layout */
+void image_size(v4l2camObject *cam, const OutputSpec *spec, int *width, int *height)
+{
+    output_size(cam, spec, width, height);
+    if (spec->layout == LAYOUT_GRID) {
+        *width *= spec->cols;
+        *height *= spec->rows;
+    }
+}
+
+/* Pads grid tile `index`, used for tiles without a camera */
+void fill_tile(v4l2camObject *cam, const OutputSpec *spec, void *dst, int index)
+{
+    int tw, th, width, height;
+    output_size(cam, spec, &tw, &th);
+    image_size(cam, spec, &width, &height);
+    int tx = (index % spec->cols)*tw, ty = (index / spec->cols)*th;
+    fill_rect(spec, dst, width, height, tx, ty, tx+tw, ty+th);
+}
+
+/* Writes a `width` x `height` ARGB image at (x0,y0) of a `dst_width` x `dst_height`
+   output. A negative height flips the image vertically. */
+static int
+store_image(const uint8_t *argb, int width, int height, const OutputSpec *spec, uint8_t *rgb,
+            void *dst, int dst_width, int dst_height, int x0, int y0)
+{
+    int elsize = output_dtype_size(spec->dtype);
+    int stride = width*4;
+    if (height < 0) {
+        height = -height;
+        argb += (size_t) (height-1)*stride;
+        stride = -stride;
+    }
+    if (spec->layout != LAYOUT_NCHW)
+        return ARGBToRAW(argb, stride, (uint8_t *) dst + ((size_t) y0*dst_width + x0)*3, dst_width*3, width, height);
+
+    size_t plane = (size_t) dst_width * dst_height * elsize;
+    if (spec->dtype == DTYPE_UINT8) {
+        uint8_t *d = (uint8_t *) dst + (size_t) y0*dst_width + x0;
+        SplitARGBPlane(argb, stride, d, dst_width, d + plane, dst_width, d + 2*plane, dst_width,
+                       NULL, 0, width, height);
+        return 0;
+    }
+    for (int y=0; y<height; y++) {
+        uint8_t *d = (uint8_t *) dst + ((size_t) (y0+y)*dst_width + x0)*elsize;
+        store_row_planar(argb + (ptrdiff_t) y*stride, width, spec, rgb, d, d + plane, d + 2*plane);
+    }
+    return 0;
+}
+
+/* Remaps tile by tile into a small ARGB block that is stored right away */
+static int
+store_remapped(const RemapLUT *lut, const uint8_t *src, int src_stride, const OutputSpec *spec, uint8_t *rgb,
+               void *dst, int dst_width, int dst_height, int tx, int ty)
+{
+    uint8_t block[REMAP_TILE_W * REMAP_TILE_H * 4];
+    for (int y0=0; y0<lut->height; y0+=REMAP_TILE_H)
+        for (int x0=0; x0<lut->width; x0+=REMAP_TILE_W) {
+            int bw = (lut->width - x0 < REMAP_TILE_W ? lut->width - x0 : REMAP_TILE_W);
+            int bh = (lut->height - y0 < REMAP_TILE_H ? lut->height - y0 : REMAP_TILE_H);
+            remap_tile(lut, x0, y0, src, src_stride, spec->pad, block, bw*4);
+            int res = store_image(block, bw, bh, spec, rgb, dst, dst_width, dst_height, tx + x0, ty + y0);
+            if (res != 0) return res;
+        }
+    return 0;
+}
+
+/* Writes a converted ARGB frame of size (out_width, out_height) to dst.
+   In grid layout dst is the whole mosaic and `index` selects the tile. */
+int store_frame(v4l2camObject *cam, uint8_t *argb, int flip_height, const OutputSpec *spec, void *dst, int index)
+{
+    int width = cam->out_width, height = flip_height, tw, th, dst_width, dst_height, tx = 0, ty = 0;
+    output_size(cam, spec, &tw, &th);
+    image_size(cam, spec, &dst_width, &dst_height);
+    if (spec->layout == LAYOUT_GRID) {
+        tx = (index % spec->cols)*tw;
+        ty = (index / spec->cols)*th;
+    }
+    int scratch_width = (tw > width ? tw : width);
+    if (cam->remap && cam->remap->width > scratch_width) scratch_width = cam->remap->width;
+    uint8_t *rgb = scratch_reserve(&cam->rgb, (size_t) scratch_width*3);
+    if (!rgb) return -1;
+
+    if (cam->remap) {
+        const RemapLUT *lut = cam->remap;
+        const uint8_t *src = argb;
+        int src_stride = width*4;
+        if (flip_height < 0) {
+            src += (size_t) (cam->out_height-1)*src_stride;
+            src_stride = -src_stride;
+        }
+        if (tw == lut->width && th == lut->height)
+            return store_remapped(lut, src, src_stride, spec, rgb, dst, dst_width, dst_height, tx, ty);
+        //Remap the whole frame before scaling it
+        argb = scratch_reserve(&cam->remapped, (size_t) lut->width*lut->height*4);
+        if (!argb) return -1;
+        remap_image(lut, src, src_stride, spec->pad, argb, lut->width*4);
+        width = lut->width;
+        height = lut->height;
+    }
+    int abs_height = (height < 0 ? -height : height);
+
+    if (tw == width && th == abs_height)
+        return store_image(argb, width, height, spec, rgb, dst, dst_width, dst_height, tx, ty);
+
+    //Letterbox: scale preserving the aspect ratio, centered, borders padded
+    double s = fmin((double) tw / width, (double) th / abs_height);
+    int w = (int) lround(width*s), h = (int) lround(abs_height*s);
+    if (w > tw) w = tw;
+    if (h > th) h = th;
+    int x0 = tx + (tw - w)/2, y0 = ty + (th - h)/2;
+    uint8_t *scaled = scratch_reserve(&cam->scaled, (size_t) w*h*4);
+    if (!scaled) return -1;
+    int res = ARGBScale(argb, width*4, width, height, scaled, w*4, w, h, kFilterBilinear);
+    if (res != 0) return res;
+    fill_border(spec, dst, dst_width, dst_height, tx, ty, tw, th, x0, y0, w, h);
+    return store_image(scaled, w, h, spec, rgb, dst, dst_width, dst_height, x0, y0);
+}
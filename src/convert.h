@@ -0,0 +1,41 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+#include <stdint.h>
+#include "multicam.h"
+#include "bayer.h"
+#include "unpack.h"
+
+#define LAYOUT_NHWC 0
+#define LAYOUT_NCHW 1
+#define LAYOUT_GRID 2 /* One HWC mosaic with a tile per camera */
+
+#define DTYPE_UINT8   0
+#define DTYPE_FLOAT32 1
+#define DTYPE_FLOAT16 2
+
+/* How converted frames are written to the output array */
+typedef struct OutputSpec {
+    int layout;
+    int dtype;
+    float scale[3];  /* R, G, B: out = pixel*scale + offset */
+    float offset[3];
+    int width;       /* Letterbox target (or grid tile) size, 0 for none */
+    int height;
+    uint8_t pad;     /* Raw pixel value of the letterbox border */
+    int rows;        /* Grid layout */
+    int cols;
+} OutputSpec;
+
+extern const OutputSpec default_output_spec;
+
+int output_dtype_size(int dtype);
+void output_size(v4l2camObject *cam, const OutputSpec *spec, int *width, int *height);
+int frame_is_complete(v4l2camObject *cam, const uint8_t *sample, size_t bytesused);
+int convert_frame(v4l2camObject *cam, const uint8_t *sample, size_t sample_size, int rotation, uint8_t *argb);
+int convert_planes(v4l2camObject *cam, const struct buffer *planes, int rotation, uint8_t *argb);
+int store_raw(v4l2camObject *cam, const uint8_t *sample, size_t sample_size, int rotation, int flip_height, uint8_t *dst);
+void image_size(v4l2camObject *cam, const OutputSpec *spec, int *width, int *height);
+uint8_t *scratch_reserve(struct buffer *b, size_t length);
+void fill_tile(v4l2camObject *cam, const OutputSpec *spec, void *dst, int index);
+int store_frame(v4l2camObject *cam, uint8_t *argb, int flip_height, const OutputSpec *spec, void *dst, int index);
+#endif //CONVERT_H
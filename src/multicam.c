@@ -3,89 +3,695 @@
 #include <structmember.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <poll.h>
 #include <linux/videodev2.h>
 #include "libyuv.h"
 #include "multicam.h"
 #include "v4l2.h"
+#include "convert.h"
+#include "remap.h"
+#include "watchdog.h"
+#include "uvcmeta.h"
 #include <fcntl.h>   
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 #define STR2FOURCC(s) FOURCC(toupper(s[0]),toupper(s[1]),toupper(s[2]),toupper(s[3]))
 
+static PyTypeObject v4l2camType;
+
+/* FOURCC of a format string; short codes such as "Y16" are padded with spaces */
+static int
+parse_fourcc(const char *format, int *res)
+{
+    char fourcc[5] = "    ";
+    size_t len = strlen(format);
+    if (len < 2 || len > 4) {
+       PyErr_Format(PyExc_ValueError, "`%s` is not a valid FOURCC", format);
+        return -1;
+    }
+    memcpy(fourcc, format, len);
+    *res = STR2FOURCC(fourcc);
+    return 0;
+}
+
+/* Sets fourcc and the derived sample layout, and the output size from width,
+   height and rotation. Returns -1 with an exception set if the combination
+   is invalid. */
+static int
+cam_set_format(v4l2camObject *self, int fourcc, int demosaic)
+{
+    self->fourcc = fourcc;
+    //Bayer
+    self->bayer = bayer_pattern(self->fourcc);
+    if (self->bayer == BAYER_BGGR)
+        self->fourcc = V4L2_PIX_FMT_SBGGR8;
+    self->demosaic = demosaic;
+    self->mono = mono16_format(self->fourcc);
+    self->channels = (self->mono >= 0 ? 1 : 3);
+    self->depth = (self->mono >= 0 ? 2 : 1);
+    if (self->bayer >= 0 && ((self->width & 1) || (self->height & 1))) {
+        PyErr_Format(PyExc_ValueError, "Bayer formats need an even size, got (%d,%d)", self->width, self->height);
+        return -1;
+    }
+    if (self->demosaic == DEMOSAIC_RAW) {
+        if (self->bayer < 0) {
+            PyErr_Format(PyExc_ValueError, "Raw passthrough requires a Bayer format, got `%.4s`", (char *) &fourcc);
+            return -1;
+        }
+        if (self->rotation || self->flip) {
+            PyErr_SetString(PyExc_ValueError, "Raw passthrough does not support rotation or flip");
+            return -1;
+        }
+        self->channels = 1;
+    }
+    if (self->rotation == 90 || self->rotation == 270) {
+        self->out_width = self->height;
+        self->out_height = self->width;
+    }
+    else {
+        self->out_width = self->width;
+        self->out_height = self->height;
+    }
+    return 0;
+}
+
 static int
 v4l2cam_init(v4l2camObject *self, PyObject *args, PyObject *kwargs)
 {
     PyObject *device = NULL;//, *tmp;
-    static char *kwlist[] = {"device", "size", "format", "fps", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|(ii)sf", kwlist,
-                                    &device, &(self->width), &(self->height), &(self->format), &(self->fps)))
+    char *flip = NULL, *demosaic = "bilinear", *metadata = NULL;
+    static char *kwlist[] = {"device", "size", "format", "fps", "rotation", "flip", "demosaic", "skip_corrupt",
+                             "stall_timeout", "metadata", "decimate", NULL};
+    self->rotation = 0;
+    self->skip_corrupt = 3;
+    self->stall_timeout = -1;
+    self->next_sequence = -1;
+    self->decimate = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|(ii)sfizsidzi", kwlist,
+                                    &device, &(self->width), &(self->height), &(self->format), &(self->fps),
+                                    &(self->rotation), &flip, &demosaic, &(self->skip_corrupt), &(self->stall_timeout),
+                                    &metadata, &(self->decimate)))
         return -1;        
+    uvcmeta_free(self->meta);
+    self->meta = NULL;
+    if (metadata && !(self->meta = uvcmeta_new(metadata))) {
+        PyErr_NoMemory();
+        return -1;
+    }
     PyObject *fspath = PyOS_FSPath(device);
     self->device = (char *) PyUnicode_AsUTF8(fspath);
-    //Format
-    if (self->format) {
-        if (strlen(self->format) != 4) {
-           PyErr_Format(PyExc_ValueError, "`%s` is not a valid FOURCC", self->format);
+    //Orientation
+    self->rotation = ((self->rotation % 360) + 360) % 360;
+    if (self->rotation % 90) {
+        PyErr_Format(PyExc_ValueError, "rotation must be a multiple of 90, got %i", self->rotation);
+        return -1;
+    }
+    self->flip = 0;
+    for (char *c = flip; c && *c; c++) {
+        if (tolower(*c) == 'h') self->flip |= FLIP_H;
+        else if (tolower(*c) == 'v') self->flip |= FLIP_V;
+        else {
+            PyErr_Format(PyExc_ValueError, "`%s` is not a valid flip; use 'h', 'v' or 'hv'", flip);
             return -1;
         }
-        self->fourcc = STR2FOURCC(self->format);
     }
-    else
-        self->fourcc = 0;
+    if (self->decimate < 1) {
+        PyErr_Format(PyExc_ValueError, "decimate must be at least 1, got %i", self->decimate);
+        return -1;
+    }
+    int algorithm = demosaic_algorithm(demosaic);
+    if (algorithm < 0) {
+        PyErr_Format(PyExc_ValueError, "Unknown demosaic `%s`; use 'nearest', 'bilinear', 'edge' or 'raw'", demosaic);
+        return -1;
+    }
+    int fourcc = 0;
+    if (self->format && parse_fourcc(self->format, &fourcc) < 0)
+        return -1;
+    if (cam_set_format(self, fourcc, algorithm) < 0)
+        return -1;
     
     self->buffers = NULL;
     self->n_buffers = 0;
     self->fd = -1;
+    pthread_mutex_init(&self->io_lock, NULL);
     return 0;
 }
 
 static void
 v4l2cam_dealloc(v4l2camObject *self)
 {
+    watchdog_remove(self);
+    uvcmeta_free(self->meta);
+    pthread_mutex_destroy(&self->io_lock);
     Py_XDECREF(self->device);
     //Py_XDECREF(self->format);
+    free(self->argb.start);
+    free(self->scaled.start);
+    free(self->rgb.start);
+    free(self->remapped.start);
+    free(self->rotated.start);
+    free(self->green.start);
+    free(self->last_raw.start);
+    remap_free(self->remap);
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
+/* Opens and configures the device and starts streaming. On failure the
+   steps already taken are undone and the first error is kept. Runs without
+   the GIL. */
+static int
+cam_bring_up(v4l2camObject *self)
+{
+    if (v4l2_open_device(self) && v4l2_init_device(self) && (!self->meta || uvcmeta_start(self->meta))
+        && v4l2_start_capturing(self)) {
+        if (self->stall_timeout >= 0) watchdog_add(self);
+        return 1;
+    }
+    PyObject *type = v4l2_error_type();
+    char message[256];
+    snprintf(message, sizeof(message), "%s", v4l2_error_message());
+    if (self->meta)
+        uvcmeta_stop(self->meta);
+    if (self->buffers)
+        v4l2_uninit_device(self);
+    v4l2_close_device(self);
+    v4l2_error(type, "%s", message);
+    return 0;
+}
+
+/* Stops streaming, unmaps and closes. Every step is tried even if an
+   earlier one fails (as all ioctls do once a device is unplugged); the
+   first error is kept. */
+static int
+cam_tear_down(v4l2camObject *self)
+{
+    PyObject *type = NULL;
+    char message[256];
+    watchdog_remove(self);
+    pthread_mutex_lock(&self->io_lock);
+    int ok[3] = {(self->fd == -1 || !self->streaming ? 1 : v4l2_stop_capturing(self)), 1, 1};
+    if (!ok[0]) {
+        type = v4l2_error_type();
+        snprintf(message, sizeof(message), "%s", v4l2_error_message());
+        self->streaming = 0;
+    }
+    ok[1] = v4l2_uninit_device(self);
+    if (!ok[1] && !type) {
+        type = v4l2_error_type();
+        snprintf(message, sizeof(message), "%s", v4l2_error_message());
+    }
+    ok[2] = v4l2_close_device(self);
+    if (self->meta) uvcmeta_stop(self->meta);
+    pthread_mutex_unlock(&self->io_lock);
+    if (type) v4l2_error(type, "%s", message);
+    return (ok[0] && ok[1] && ok[2]);
+}
+
 PyObject *
 v4l2cam_start(v4l2camObject *self, PyObject *args)
 {
-    if (v4l2_open_device(self) == 0) {
-        v4l2_close_device(self);
+    int ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = cam_bring_up(self);
+    Py_END_ALLOW_THREADS
+    if (!ok)
+        return v4l2_raise();
+    Py_RETURN_NONE;
+}
+
+PyObject *
+v4l2cam_stop(v4l2camObject *self, PyObject *args)
+{
+    if (!cam_tear_down(self))
+        return v4l2_raise();
+    Py_RETURN_NONE;
+}
+
+/* Stops streaming but keeps the device open and its buffers mapped */
+PyObject *
+v4l2cam_pause(v4l2camObject *self, PyObject *args)
+{
+    int ok = 1;
+    if (self->fd == -1) {
+        PyErr_SetString(PyExc_RuntimeError, "Camera has not been started");
         return NULL;
     }
-    else {
-        int initres = v4l2_init_device(self);
-        if (initres == 0) {
-            v4l2_close_device(self);
-            return NULL;
-        }
-        if (v4l2_start_capturing(self) == 0) {
-            v4l2_close_device(self);
-            return NULL;
-        }
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->io_lock);
+    if (self->streaming) ok = v4l2_stop_capturing(self);
+    pthread_mutex_unlock(&self->io_lock);
+    Py_END_ALLOW_THREADS
+    if (!ok)
+        return v4l2_raise();
+    Py_RETURN_NONE;
+}
+
+/* Requeues all buffers and restarts streaming after pause() */
+PyObject *
+v4l2cam_resume(v4l2camObject *self, PyObject *args)
+{
+    int ok = 1;
+    if (self->fd == -1) {
+        PyErr_SetString(PyExc_RuntimeError, "Camera has not been started");
+        return NULL;
     }
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->io_lock);
+    if (!self->streaming) ok = v4l2_start_capturing(self);
+    pthread_mutex_unlock(&self->io_lock);
+    Py_END_ALLOW_THREADS
+    if (!ok)
+        return v4l2_raise();
     Py_RETURN_NONE;
 }
 
+/* Reads convert and store frames without the GIL or io_lock, using the
+   format, scratch buffers, remap LUT and frame selection state. These may
+   not change under them, so changing them, and a second read of the same
+   camera, are refused while a read is in progress. */
+static int
+cam_reading(v4l2camObject *self, const char *what)
+{
+    if (self->readers > 0)
+        PyErr_Format(PyExc_RuntimeError, "Cannot %s while a read of the camera is in progress", what);
+    return self->readers > 0;
+}
+
+/* Changes size, format and/or fps on the open device. A new fps only needs
+   S_PARM; a new size or format needs the driver's buffers released first,
+   as drivers refuse S_FMT while buffers exist. Scratch buffers are kept and
+   only grow. If the device rejects the new settings the camera is stopped. */
 PyObject *
-v4l2cam_stop(v4l2camObject *self, PyObject *args)
+v4l2cam_reconfigure(v4l2camObject *self, PyObject *args, PyObject *kwargs)
 {
-    if (v4l2_stop_capturing(self) == 0)
+    PyObject *size = Py_None;
+    char *format = NULL;
+    float fps = 0;
+    static char *kwlist[] = {"size", "format", "fps", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Ozf", kwlist, &size, &format, &fps))
         return NULL;
-    if (v4l2_uninit_device(self) == 0)
+    if (cam_reading(self, "reconfigure"))
         return NULL;
-    if (v4l2_close_device(self) == 0)
+    //Validate the new settings before touching the device
+    struct {
+        int width, height, fourcc, bayer, mono, channels, depth, out_width, out_height;
+        float fps;
+    } saved = {self->width, self->height, self->fourcc, self->bayer, self->mono, self->channels,
+               self->depth, self->out_width, self->out_height, self->fps};
+    int fourcc = self->fourcc;
+    if (format && parse_fourcc(format, &fourcc) < 0)
         return NULL;
+    if (size != Py_None && !PyArg_ParseTuple(size, "ii", &self->width, &self->height))
+        goto restore;
+    if (fps > 0) self->fps = fps;
+    if (cam_set_format(self, fourcc, self->demosaic) < 0)
+        goto restore;
+    if (self->remap && (self->out_width != saved.out_width || self->out_height != saved.out_height ||
+                        self->channels == 1)) {
+        PyErr_SetString(PyExc_ValueError, "Clear the remap (set_remap()) before changing the output size");
+        goto restore;
+    }
+    if (self->fd == -1) //Not started: applies on start()
+        Py_RETURN_NONE;
+
+    int new_format = (self->width != saved.width || self->height != saved.height || self->fourcc != saved.fourcc);
+    int new_fps = (self->fps != saved.fps);
+    int ok = 1, streaming = self->streaming;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->io_lock);
+    if (streaming) ok = v4l2_stop_capturing(self);
+    if (ok && new_format)
+        ok = (v4l2_free_buffers(self) && v4l2_set_format(self) && v4l2_set_fps(self) && v4l2_init_mmap(self));
+    else if (ok && new_fps)
+        ok = v4l2_set_fps(self);
+    if (ok && streaming) ok = v4l2_start_capturing(self);
+    pthread_mutex_unlock(&self->io_lock);
+    if (!ok) { //Leave nothing half configured
+        PyObject *type = v4l2_error_type();
+        char message[256];
+        snprintf(message, sizeof(message), "%s", v4l2_error_message());
+        cam_tear_down(self);
+        v4l2_error(type, "%s", message);
+    }
+    Py_END_ALLOW_THREADS
+    if (!ok)
+        return v4l2_raise();
     Py_RETURN_NONE;
+
+    restore:
+    self->width = saved.width;
+    self->height = saved.height;
+    self->fps = saved.fps;
+    self->fourcc = saved.fourcc;
+    self->bayer = saved.bayer;
+    self->mono = saved.mono;
+    self->channels = saved.channels;
+    self->depth = saved.depth;
+    self->out_width = saved.out_width;
+    self->out_height = saved.out_height;
+    return NULL;
+}
+
+typedef struct CamStartWorkerArgStruct {
+    v4l2camObject *cam;
+    int joinable;
+    int res;
+    PyObject *error_type;
+    char error[256];
+} CamStartWorkerArgStruct;
+
+void *
+cam_start_worker(void *argp)
+{
+    CamStartWorkerArgStruct *args = argp;
+    args->res = cam_bring_up(args->cam);
+    if (!args->res) {
+        args->error_type = v4l2_error_type();
+        snprintf(args->error, sizeof(args->error), "%s", v4l2_error_message());
+    }
+    return NULL;
+}
+
+/* Brings up all cameras concurrently with the GIL released, since each
+   S_FMT/S_PARM/REQBUFS/STREAMON round trip can take hundreds of ms. If any
+   camera fails, the others are stopped again and the errors of all failed
+   cameras are raised together. */
+static PyObject *
+camsys_start(PyObject *self, PyObject *cams)
+{
+    pthread_t *threads = NULL;
+    CamStartWorkerArgStruct *cam_args = NULL;
+    PyObject *res = NULL, *seq = PySequence_Fast(cams, "cams must be a sequence of v4l2cam objects");
+    if (!seq) return NULL;
+    int N = (int) PySequence_Fast_GET_SIZE(seq);
+    if (N <= 0) {
+        PyErr_SetString(PyExc_ValueError, "No cameras to start.");
+        goto RETURN;
+    }
+    for (int i=0; i<N; i++) {
+        PyObject *cam = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(cam, &v4l2camType)) {
+            PyErr_Format(PyExc_TypeError, "Item %i is not a v4l2cam", i);
+            goto RETURN;
+        }
+        if (((v4l2camObject *) cam)->fd != -1) {
+            PyErr_Format(PyExc_ValueError, "Camera %i is already started", i);
+            goto RETURN;
+        }
+    }
+    threads = (pthread_t *) malloc((size_t) N*sizeof(pthread_t));
+    cam_args = (CamStartWorkerArgStruct *) calloc((size_t) N, sizeof(CamStartWorkerArgStruct));
+    if (!threads || !cam_args) {
+        PyErr_NoMemory();
+        goto RETURN;
+    }
+    int failed = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for (int i=0; i<N; i++) {
+        cam_args[i].cam = (v4l2camObject *) PySequence_Fast_GET_ITEM(seq, i);
+        cam_args[i].joinable = (pthread_create(&threads[i], NULL, cam_start_worker, &cam_args[i]) == 0);
+        if (!cam_args[i].joinable) //No thread: bring this one up here instead
+            cam_start_worker(&cam_args[i]);
+    }
+    for (int i=0; i<N; i++) {
+        if (cam_args[i].joinable) pthread_join(threads[i], NULL);
+        if (!cam_args[i].res) failed++;
+    }
+    if (failed) //Roll back the cameras that did come up
+        for (int i=0; i<N; i++)
+            if (cam_args[i].res) cam_tear_down(cam_args[i].cam);
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        PyObject *type = NULL, *msg = PyUnicode_FromFormat("Starting %i of %i cameras failed", failed, N);
+        for (int i=0; msg && i<N; i++) {
+            if (cam_args[i].res) continue;
+            if (!type) type = cam_args[i].error_type;
+            PyObject *m = PyUnicode_FromFormat("%U; camera %i: %s", msg, i, cam_args[i].error);
+            Py_DECREF(msg);
+            msg = m;
+        }
+        if (msg) {
+            PyErr_SetObject(type, msg);
+            Py_DECREF(msg);
+        }
+        goto RETURN;
+    }
+    res = Py_None;
+    Py_INCREF(res);
+    RETURN:
+    free(threads);
+    free(cam_args);
+    Py_DECREF(seq);
+    return res;
+}
+
+typedef struct CamControlWorkerArgStruct {
+    v4l2camObject *cam;
+    struct v4l2_ext_control *ctrls;
+    struct v4l2_ext_control *saved; /* Values before, for rolling back */
+    unsigned int count;
+    int joinable;
+    int res;
+    int restorable;
+    PyObject *error_type;
+    char error[256];
+} CamControlWorkerArgStruct;
+
+void *
+cam_control_worker(void *argp)
+{
+    CamControlWorkerArgStruct *args = argp;
+    v4l2camObject *cam = args->cam;
+    pthread_mutex_lock(&cam->io_lock);
+    if (cam->fd == -1) {
+        v4l2_error(PyExc_RuntimeError, "Camera has not been started");
+        args->res = 0;
+    }
+    else {
+        memcpy(args->saved, args->ctrls, args->count * sizeof(*args->ctrls));
+        //Write-only controls (buttons) cannot be read back, nor rolled back
+        args->restorable = v4l2_get_controls(cam, args->saved, args->count);
+        args->res = v4l2_set_controls(cam, args->ctrls, args->count);
+    }
+    pthread_mutex_unlock(&cam->io_lock);
+    if (!args->res) {
+        args->error_type = v4l2_error_type();
+        snprintf(args->error, sizeof(args->error), "%s", v4l2_error_message());
+    }
+    return NULL;
+}
+
+/* camsys_set_controls(cams, controls): sets controls on all cameras in
+   parallel, with controls[i] a sequence of (id, value) for cams[i]. Each
+   camera gets one VIDIOC_S_EXT_CTRLS. If any camera fails, the others are
+   set back to their previous values and the errors are raised together. */
+static PyObject *
+camsys_set_controls(PyObject *self, PyObject *args)
+{
+    PyObject *cams, *controls, *res = NULL, *seq = NULL, *ctrl_seq = NULL;
+    pthread_t *threads = NULL;
+    CamControlWorkerArgStruct *cam_args = NULL;
+    if (!PyArg_ParseTuple(args, "OO", &cams, &controls))
+        return NULL;
+    seq = PySequence_Fast(cams, "cams must be a sequence of v4l2cam objects");
+    ctrl_seq = (seq ? PySequence_Fast(controls, "controls must be a sequence with one entry per camera") : NULL);
+    if (!ctrl_seq) goto RETURN;
+    int N = (int) PySequence_Fast_GET_SIZE(seq);
+    if (PySequence_Fast_GET_SIZE(ctrl_seq) != N) {
+        PyErr_Format(PyExc_ValueError, "Expected controls for %i cameras, got %zd", N, PySequence_Fast_GET_SIZE(ctrl_seq));
+        goto RETURN;
+    }
+    threads = (pthread_t *) malloc((size_t) (N > 0 ? N : 1) * sizeof(pthread_t));
+    cam_args = (CamControlWorkerArgStruct *) calloc((size_t) (N > 0 ? N : 1), sizeof(CamControlWorkerArgStruct));
+    if (!threads || !cam_args) {
+        PyErr_NoMemory();
+        goto RETURN;
+    }
+    for (int i=0; i<N; i++) {
+        PyObject *cam = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(cam, &v4l2camType)) {
+            PyErr_Format(PyExc_TypeError, "Item %i is not a v4l2cam", i);
+            goto RETURN;
+        }
+        PyObject *items = PySequence_Fast(PySequence_Fast_GET_ITEM(ctrl_seq, i), "controls must be (id, value) pairs");
+        if (!items) goto RETURN;
+        unsigned int count = (unsigned int) PySequence_Fast_GET_SIZE(items);
+        cam_args[i].cam = (v4l2camObject *) cam;
+        cam_args[i].count = count;
+        cam_args[i].ctrls = calloc(count ? count : 1, sizeof(struct v4l2_ext_control));
+        cam_args[i].saved = calloc(count ? count : 1, sizeof(struct v4l2_ext_control));
+        if (!cam_args[i].ctrls || !cam_args[i].saved) {
+            Py_DECREF(items);
+            PyErr_NoMemory();
+            goto RETURN;
+        }
+        for (unsigned int j=0; j<count; j++) {
+            if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(items, j), "Ii;controls must be (id, value) pairs",
+                                  &cam_args[i].ctrls[j].id, &cam_args[i].ctrls[j].value)) {
+                Py_DECREF(items);
+                goto RETURN;
+            }
+        }
+        Py_DECREF(items);
+    }
+    int failed = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for (int i=0; i<N; i++) {
+        if (!cam_args[i].count) {
+            cam_args[i].res = 1;
+            continue;
+        }
+        cam_args[i].joinable = (pthread_create(&threads[i], NULL, cam_control_worker, &cam_args[i]) == 0);
+        if (!cam_args[i].joinable)
+            cam_control_worker(&cam_args[i]);
+    }
+    for (int i=0; i<N; i++) {
+        if (cam_args[i].joinable) pthread_join(threads[i], NULL);
+        if (!cam_args[i].res) failed++;
+    }
+    if (failed) //Undo the cameras that took the new values
+        for (int i=0; i<N; i++) {
+            if (!cam_args[i].res || !cam_args[i].restorable || !cam_args[i].count) continue;
+            pthread_mutex_lock(&cam_args[i].cam->io_lock);
+            if (cam_args[i].cam->fd != -1)
+                v4l2_set_controls(cam_args[i].cam, cam_args[i].saved, cam_args[i].count);
+            pthread_mutex_unlock(&cam_args[i].cam->io_lock);
+        }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        PyObject *type = NULL, *msg = PyUnicode_FromFormat("Setting controls failed on %i of %i cameras", failed, N);
+        for (int i=0; msg && i<N; i++) {
+            if (cam_args[i].res) continue;
+            if (!type) type = cam_args[i].error_type;
+            PyObject *m = PyUnicode_FromFormat("%U; camera %i: %s", msg, i, cam_args[i].error);
+            Py_DECREF(msg);
+            msg = m;
+        }
+        if (msg) {
+            PyErr_SetObject(type, msg);
+            Py_DECREF(msg);
+        }
+        goto RETURN;
+    }
+    res = Py_None;
+    Py_INCREF(res);
+    RETURN:
+    if (cam_args) {
+        for (int i=0; seq && i<PySequence_Fast_GET_SIZE(seq); i++) {
+            free(cam_args[i].ctrls);
+            free(cam_args[i].saved);
+        }
+    }
+    free(threads);
+    free(cam_args);
+    Py_XDECREF(seq);
+    Py_XDECREF(ctrl_seq);
+    return res;
+}
+
+/* get_controls(ids): current values, with one VIDIOC_G_EXT_CTRLS */
+PyObject *
+v4l2cam_get_controls(v4l2camObject *self, PyObject *ids)
+{
+    PyObject *res = NULL, *seq = PySequence_Fast(ids, "ids must be a sequence of control ids");
+    if (!seq) return NULL;
+    unsigned int count = (unsigned int) PySequence_Fast_GET_SIZE(seq);
+    struct v4l2_ext_control *ctrls = calloc(count ? count : 1, sizeof(*ctrls));
+    if (!ctrls) {
+        PyErr_NoMemory();
+        goto RETURN;
+    }
+    for (unsigned int j=0; j<count; j++) {
+        ctrls[j].id = (__u32) PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, j));
+        if (PyErr_Occurred()) goto RETURN;
+    }
+    int ok = 0, started = 1;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->io_lock);
+    started = (self->fd != -1);
+    if (started) ok = (count == 0 || v4l2_get_controls(self, ctrls, count));
+    pthread_mutex_unlock(&self->io_lock);
+    Py_END_ALLOW_THREADS
+    if (!started) {
+        PyErr_SetString(PyExc_RuntimeError, "Camera has not been started");
+        goto RETURN;
+    }
+    if (!ok) {
+        v4l2_raise();
+        goto RETURN;
+    }
+    res = PyList_New(count);
+    for (unsigned int j=0; res && j<count; j++) {
+        PyObject *v = PyLong_FromLong(ctrls[j].value);
+        if (!v) Py_CLEAR(res);
+        else PyList_SET_ITEM(res, j, v);
+    }
+    RETURN:
+    free(ctrls);
+    Py_DECREF(seq);
+    return res;
 }
 
 typedef struct CamReadWorkerArgStruct {
     v4l2camObject *cam;
     uint8_t *dst;
+    const OutputSpec *spec;
+    int index; //Tile index in grid layout
     int res;
+    int err;   //errno of a failed ioctl
 } CamReadWorkerArgStruct;
 
+/* Raised by reads when a camera is gone (unplugged or reset) */
+static PyObject *DeviceLost;
+
+#define IS_DEVICE_LOST(err) ((err) == ENODEV || (err) == ENXIO)
+
+/* Whether decimation keeps frame `sequence`: the first frame from each
+   block of cam->decimate sequence numbers, so frames the driver dropped do
+   not shift the cadence. */
+static int
+decimate_keep(v4l2camObject *cam, uint32_t sequence)
+{
+    if (sequence + (int64_t) cam->decimate < cam->next_keep) //Restarted stream
+        cam->next_keep = 0;
+    if (sequence < cam->next_keep)
+        return 0;
+    cam->next_keep = ((int64_t) sequence / cam->decimate + 1) * cam->decimate;
+    return 1;
+}
+
+/* Dequeues the next frame, waiting in poll() without io_lock so the stall
+   watchdog can restart the stream meanwhile. Returns 1 with io_lock held,
+   or 0 with *err set. */
+static int
+cam_dequeue(v4l2camObject *cam, struct v4l2_buffer *buf, struct v4l2_plane *planes, int *err)
+{
+    for (;;) {
+        pthread_mutex_lock(&cam->io_lock);
+        if (cam->fd == -1 || !cam->streaming) { //Closed by a failed watchdog reopen, or paused
+            *err = (cam->fd == -1 ? ENODEV : EINVAL);
+            pthread_mutex_unlock(&cam->io_lock);
+            return 0;
+        }
+        v4l2_prepare_buffer(cam, buf, planes, 0);
+        if (0 == v4l2_xioctl(cam->fd, VIDIOC_DQBUF, buf)) {
+            cam->last_frame_ns = monotonic_ns();
+            cam->stall_level = 0;
+            return 1;
+        }
+        struct pollfd pfd = {cam->fd, POLLIN, 0};
+        *err = errno;
+        pthread_mutex_unlock(&cam->io_lock);
+        if (*err != EAGAIN) {
+            if (!IS_DEVICE_LOST(*err))
+                fprintf(stderr, "ioctl(VIDIOC_DQBUF) failure : %d, %s", *err, strerror(*err));
+            return 0;
+        }
+        //Bounded, since a reopen closes the fd and that does not wake poll()
+        poll(&pfd, 1, 100);
+    }
+}
+
 void *
 cam_read_worker(void *argp)
 {
@@ -94,46 +700,136 @@ cam_read_worker(void *argp)
     uint8_t *dst = args->dst;
     int libyuv_res;
     
-    uint8_t argb[cam->height * cam->width * 4];
-    
-    //Prepare buffer
-    struct v4l2_buffer buf;
-    CLEAR(buf);
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    //Dequeue buffer
-    if (-1 == v4l2_xioctl(cam->fd, VIDIOC_DQBUF, &buf)) {
-        fprintf(stderr, "ioctl(VIDIOC_DQBUF) failure : %d, %s", errno, strerror(errno));
-        args->res = 1;
+    uint8_t *argb = scratch_reserve(&cam->argb, (size_t) cam->height * cam->width * 4);
+    if (!argb) {
+        fprintf(stderr, "Out of memory\n");
+        args->res = 5;
         return NULL;
     }
     
-    //Convert to ARGB
-    libyuv_res = ConvertToARGB(
-                   (uint8_t *) cam->buffers[buf.index].start, //sample
-                   cam->buffers[buf.index].length, //sample_size
-                   argb, cam->width*4, //dst, dst_stride
-                   0, 0, //crop_x, crop_y
-                   cam->width, cam->height,
-                   cam->width, cam->height,
-                   kRotate0, //RotationMode
-                   cam->fourcc); //FOURCC
+    /* A horizontal mirror equals a vertical one plus a half turn, so both
+       flips fold into the rotation and the sign of the final copy's height. */
+    int rotation = cam->rotation;
+    int flip_height = cam->out_height;
+    if (cam->flip & FLIP_H) {
+        rotation = (rotation + 180) % 360;
+        flip_height = -flip_height;
+    }
+    if (cam->flip & FLIP_V)
+        flip_height = -flip_height;
+    
+    /* A repeat stores the last frame again: color frames from the ARGB
+       scratch, which holds the last conversion, single-channel ones from the
+       copy kept for this. */
+    size_t raw_size = (size_t) cam->out_width * cam->out_height * cam->depth;
+    int repeat = cam->repeat && cam->timestamp_ns &&
+                 (cam->channels != 1 || (cam->last_raw.start && cam->last_raw.length >= raw_size));
+    cam->repeat = 0;
+    if (repeat) {
+        cam->repeated_frames++;
+        if (cam->channels == 1) {
+            memcpy(dst, cam->last_raw.start, raw_size);
+            args->res = 0;
+            return NULL;
+        }
+    }
     
-    if (libyuv_res != 0) {
-        fprintf(stderr, "libyuv ConvertToARGB failed: %i\n", libyuv_res);
-        args->res = 2;
-        return NULL;
+    /* Every dequeued buffer goes back to the driver, whatever happens to its
+       frame; a buffer kept out of the queue is lost until STREAMOFF. Corrupt
+       frames are skipped up to cam->skip_corrupt times in a row. */
+    for (int skipped = 0; !repeat; skipped++) {
+        struct v4l2_buffer buf;
+        struct v4l2_plane planes[MAX_PLANES];
+        if (!cam_dequeue(cam, &buf, planes, &args->err)) {
+            args->res = 1;
+            return NULL;
+        }
+        /* Pass over frames older than the one asked for, and those decimation
+           leaves out, without converting them. A frame far older than asked
+           for can only come from a restarted stream, whose numbering began anew. */
+        int pass = 0;
+        if (cam->next_sequence > buf.sequence && cam->next_sequence - buf.sequence <= 2 * (int64_t) cam->n_buffers) {
+            cam->stale_frames++;
+            pass = 1;
+        }
+        else if (cam->decimate > 1 && !decimate_keep(cam, buf.sequence)) {
+            cam->decimated_frames++;
+            pass = 1;
+        }
+        if (pass) {
+            int queued = (0 == v4l2_xioctl(cam->fd, VIDIOC_QBUF, &buf));
+            if (!queued) args->err = errno;
+            pthread_mutex_unlock(&cam->io_lock);
+            if (!queued) {
+                args->res = 3;
+                return NULL;
+            }
+            skipped--;
+            continue;
+        }
+        
+        //Convert to ARGB, or copy the raw mosaic straight to dst
+        struct buffer *sample = &cam->buffers[buf.index * cam->n_planes];
+        size_t bytesused = (cam->buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ? planes[0].bytesused : buf.bytesused);
+        if (bytesused == 0 || bytesused > sample->length) //Not reported
+            bytesused = sample->length;
+        libyuv_res = -1;
+        if (buf.flags & V4L2_BUF_FLAG_ERROR)
+            cam->error_frames++;
+        else if (!frame_is_complete(cam, (uint8_t *) sample->start, bytesused))
+            ;
+        else if (cam->channels == 1)
+            libyuv_res = store_raw(cam, (uint8_t *) sample->start, bytesused,
+                                   rotation, flip_height, dst);
+        else if (cam->n_planes > 1)
+            libyuv_res = convert_planes(cam, sample, rotation, argb);
+        else
+            libyuv_res = convert_frame(cam, (uint8_t *) sample->start,
+                                       bytesused, rotation, argb);
+        
+        //Re-queue buffer, and take pending events while the device can't be reopened under us
+        int queued = (0 == v4l2_xioctl(cam->fd, VIDIOC_QBUF, &buf));
+        if (!queued) args->err = errno;
+        else if (libyuv_res == 0) v4l2_poll_events(cam);
+        pthread_mutex_unlock(&cam->io_lock);
+        if (!queued) {
+            if (!IS_DEVICE_LOST(args->err))
+                fprintf(stderr, "v4l2 ioctl(VIDIOC_QBOF) failed:  %d, %s", args->err, strerror(args->err));
+            args->res = 3;
+            return NULL;
+        }
+        if (libyuv_res == 0) {
+            cam->sequence = buf.sequence;
+            cam->next_sequence = -1;
+            cam->timestamp_ns = v4l2_frame_timestamp(cam, &buf, cam->last_frame_ns);
+            cam->tstamp_flags = buf.flags & (V4L2_BUF_FLAG_TIMESTAMP_MASK | V4L2_BUF_FLAG_TSTAMP_SRC_MASK);
+            if (cam->meta) { //PTS marks the start of exposure
+                int64_t t = uvcmeta_frame_time(cam->meta, buf.sequence);
+                cam->hw_timestamp_ns = (t ? t + (int64_t) cam->exposure * 50000 : 0);
+                cam->device_clock_hz = uvcmeta_clock_hz(cam->meta);
+            }
+            break;
+        }
+        cam->corrupt_frames++;
+        cam->next_keep = buf.sequence + 1; //Take the next frame in place of a corrupt one
+        if (skipped >= cam->skip_corrupt) {
+            args->res = 2;
+            return NULL;
+        }
+        cam->skipped_frames++;
     }
-    //Re-queue buffer
-    if (-1 == v4l2_xioctl(cam->fd, VIDIOC_QBUF, &buf)) {
-        fprintf(stderr, "v4l2 ioctl(VIDIOC_QBOF) failed:  %d, %s", errno, strerror(errno));
-        args->res = 3;
+    if (cam->channels == 1) {
+        if (cam->keep_last) {
+            uint8_t *last = scratch_reserve(&cam->last_raw, raw_size);
+            if (last) memcpy(last, dst, raw_size);
+        }
+        args->res = 0;
         return NULL;
     }
-    //Convert to RGB, put in dst
-    libyuv_res = ARGBToRAW(argb, cam->width*4, dst, cam->width*3, cam->width, cam->height);
+    //Convert to RGB or normalized tensor, put in dst
+    libyuv_res = store_frame(cam, argb, flip_height, args->spec, dst, args->index);
     if (libyuv_res != 0) {
-        fprintf(stderr, "libyuv ARGBtoRAW failed: %i\n", libyuv_res);
+        fprintf(stderr, "Storing frame failed: %i\n", libyuv_res);
         args->res = 4;
         return NULL;
     }
@@ -142,43 +838,232 @@ cam_read_worker(void *argp)
     return NULL;
 }
 
+/* New array for the output of one camera; *dst is set to its data */
+static PyObject *
+new_camera_array(v4l2camObject *cam, const OutputSpec *spec, uint8_t **dst)
+{
+    int width, height, nd = 3;
+    output_size(cam, spec, &width, &height);
+    int typenum = (spec->dtype == DTYPE_FLOAT32 ? NPY_FLOAT32 : (spec->dtype == DTYPE_FLOAT16 ? NPY_FLOAT16 : NPY_UINT8));
+    npy_intp dims[3] = {height, width, 3};
+    if (cam->channels == 1) {
+        nd = 2;
+        typenum = (cam->depth == 2 ? NPY_UINT16 : NPY_UINT8);
+    }
+    else if (spec->layout == LAYOUT_NCHW) {
+        dims[0] = 3;
+        dims[1] = height;
+        dims[2] = width;
+    }
+    PyObject *arr = PyArray_SimpleNew(nd, dims, typenum);
+    if (arr) *dst = (uint8_t *) PyArray_DATA((PyArrayObject *) arr);
+    return arr;
+}
+
 PyObject *
 v4l2cam_read(v4l2camObject *self)
 {
     pthread_t thread;
     CamReadWorkerArgStruct cam_args;
-    PyObject *res;
-    uint8_t *dst = PyDataMem_NEW(self->width * self->height * 3);
+    uint8_t *dst;
+    if (!self->streaming) {
+        PyErr_SetString(PyExc_RuntimeError, "Camera is not streaming (stopped or paused)");
+        return NULL;
+    }
+    if (cam_reading(self, "read"))
+        return NULL;
+    PyObject *res = new_camera_array(self, &default_output_spec, &dst);
+    if (!res) return NULL;
     
     //Prepare thread args
-    cam_args = (CamReadWorkerArgStruct){self, dst, 0};
-    //Run thread
+    cam_args = (CamReadWorkerArgStruct){self, dst, &default_output_spec, 0, 0};
+    //Run thread; self must outlive the worker, whatever other threads drop meanwhile
+    Py_INCREF(self);
+    self->readers++;
+    Py_BEGIN_ALLOW_THREADS
     pthread_create(&thread, NULL, cam_read_worker, (void *)(&cam_args));
     pthread_join(thread, NULL);
+    Py_END_ALLOW_THREADS
+    self->readers--;
+    Py_DECREF(self);
     //Check for errors
+    if (cam_args.res && IS_DEVICE_LOST(cam_args.err)) {
+        PyObject *value = Py_BuildValue("(s[i])", "Camera disconnected", 0);
+        PyErr_SetObject(DeviceLost, value);
+        Py_XDECREF(value);
+        Py_DECREF(res);
+        return NULL;
+    }
     if (cam_args.res) {
-        PyErr_Format(PyExc_RuntimeError, "Reading image failed: %i\n", cam_args.res);
+        if (cam_args.res == 2)
+            PyErr_Format(PyExc_RuntimeError, "Reading image failed: %i corrupt frame(s) in a row", self->skip_corrupt + 1);
+        else
+            PyErr_Format(PyExc_RuntimeError, "Reading image failed: %i\n", cam_args.res);
+        Py_DECREF(res);
+        return NULL;
+    }
+    return res;
+}
+
+/* Dequeues the next frame and hands its buffer straight back, without
+   converting it, so a consumer keeping its own queue can shed frames
+   cheaply. Returns the frame's sequence number. */
+PyObject *
+v4l2cam_discard(v4l2camObject *self, PyObject *args)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[MAX_PLANES];
+    int ok, err = 0;
+    if (!self->streaming) {
+        PyErr_SetString(PyExc_RuntimeError, "Camera is not streaming (stopped or paused)");
         return NULL;
     }
-    //To Numpy array
-    npy_intp dims[3] = {self->height, self->width, 3};
-    res = PyArray_New(&PyArray_Type, 3, dims, NPY_UINT8, NULL, dst, 1, NPY_ARRAY_OWNDATA, NULL);
-    if (!res) {
-        PyErr_SetString(PyExc_RuntimeError, "PyArray_NEW failed\n");
+    if (cam_reading(self, "discard a frame"))
         return NULL;
+    self->readers++;
+    Py_BEGIN_ALLOW_THREADS
+    ok = cam_dequeue(self, &buf, planes, &err);
+    if (ok) {
+        if (0 != v4l2_xioctl(self->fd, VIDIOC_QBUF, &buf)) {
+            err = errno;
+            ok = 0;
+        }
+        pthread_mutex_unlock(&self->io_lock);
     }
-    
+    Py_END_ALLOW_THREADS
+    self->readers--;
+    if (!ok && IS_DEVICE_LOST(err)) {
+        PyObject *value = Py_BuildValue("(s[i])", "Camera disconnected", 0);
+        PyErr_SetObject(DeviceLost, value);
+        Py_XDECREF(value);
+        return NULL;
+    }
+    if (!ok) {
+        PyErr_Format(PyExc_RuntimeError, "Discarding frame failed: %d, %s", err, strerror(err));
+        return NULL;
+    }
+    return PyLong_FromUnsignedLong(buf.sequence);
+}
+
+PyObject *
+v4l2cam_set_remap(v4l2camObject *self, PyObject *args)
+{
+    PyObject *pymap_x = Py_None, *pymap_y = Py_None;
+    PyArrayObject *map_x = NULL, *map_y = NULL;
+    PyObject *res = NULL;
+    RemapLUT *lut;
+    if (!PyArg_ParseTuple(args, "|OO", &pymap_x, &pymap_y)) return NULL;
+    if (cam_reading(self, "change the remap"))
+        return NULL;
+    if (pymap_x == Py_None) { //Disable remapping
+        remap_free(self->remap);
+        self->remap = NULL;
+        Py_RETURN_NONE;
+    }
+    if (self->channels == 1) {
+        PyErr_SetString(PyExc_ValueError, "Remapping requires RGB output");
+        return NULL;
+    }
+    map_x = (PyArrayObject *) PyArray_FROM_OTF(pymap_x, NPY_FLOAT32, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+    if (!map_x) goto RETURN;
+    map_y = (PyArrayObject *) PyArray_FROM_OTF(pymap_y, NPY_FLOAT32, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST);
+    if (!map_y) goto RETURN;
+    if (PyArray_NDIM(map_x) != 2 || PyArray_NDIM(map_y) != 2 ||
+        PyArray_DIM(map_x, 0) != PyArray_DIM(map_y, 0) || PyArray_DIM(map_x, 1) != PyArray_DIM(map_y, 1)) {
+        PyErr_SetString(PyExc_ValueError, "map_x and map_y must be 2D arrays of the same shape");
+        goto RETURN;
+    }
+    lut = remap_create((const float *) PyArray_DATA(map_x), (const float *) PyArray_DATA(map_y),
+                       (int) PyArray_DIM(map_x, 1), (int) PyArray_DIM(map_x, 0), self->out_width, self->out_height);
+    if (!lut) {
+        PyErr_Format(PyExc_ValueError, "Cannot build a remap LUT of size (%d,%d) for (%d,%d) frames",
+                     (int) PyArray_DIM(map_x, 1), (int) PyArray_DIM(map_x, 0), self->out_width, self->out_height);
+        goto RETURN;
+    }
+    remap_free(self->remap);
+    self->remap = lut;
+    res = Py_None;
+    Py_INCREF(res);
+    RETURN:
+    Py_XDECREF(map_x);
+    Py_XDECREF(map_y);
     return res;
 }
 
+/* Fills an OutputSpec from the keyword arguments of camsys_read */
+static int
+parse_output_spec(OutputSpec *spec, const char *layout, const char *dtype,
+                  PyObject *scale, PyObject *offset, PyObject *letterbox, int pad, PyObject *grid)
+{
+    *spec = default_output_spec;
+    if (!strcmp(layout, "nhwc")) spec->layout = LAYOUT_NHWC;
+    else if (!strcmp(layout, "nchw")) spec->layout = LAYOUT_NCHW;
+    else if (!strcmp(layout, "grid")) spec->layout = LAYOUT_GRID;
+    else {
+        PyErr_Format(PyExc_ValueError, "Unknown layout `%s`", layout);
+        return 0;
+    }
+    if (!strcmp(dtype, "uint8")) spec->dtype = DTYPE_UINT8;
+    else if (!strcmp(dtype, "float32")) spec->dtype = DTYPE_FLOAT32;
+    else if (!strcmp(dtype, "float16")) spec->dtype = DTYPE_FLOAT16;
+    else {
+        PyErr_Format(PyExc_ValueError, "Unsupported dtype `%s`", dtype);
+        return 0;
+    }
+    if (spec->dtype != DTYPE_UINT8 && spec->layout != LAYOUT_NCHW) {
+        PyErr_SetString(PyExc_ValueError, "Float output requires layout 'nchw'");
+        return 0;
+    }
+    if (scale != Py_None && !PyArg_ParseTuple(scale, "fff;scale must be 3 floats",
+                                              &spec->scale[0], &spec->scale[1], &spec->scale[2]))
+        return 0;
+    if (offset != Py_None && !PyArg_ParseTuple(offset, "fff;offset must be 3 floats",
+                                               &spec->offset[0], &spec->offset[1], &spec->offset[2]))
+        return 0;
+    if (letterbox != Py_None) {
+        if (!PyArg_ParseTuple(letterbox, "ii;letterbox must be (width, height)", &spec->width, &spec->height))
+            return 0;
+        if (spec->width <= 0 || spec->height <= 0) {
+            PyErr_SetString(PyExc_ValueError, "letterbox size must be positive");
+            return 0;
+        }
+    }
+    if (pad < 0 || pad > 255) {
+        PyErr_SetString(PyExc_ValueError, "pad must be in [0, 255]");
+        return 0;
+    }
+    spec->pad = (uint8_t) pad;
+    if (spec->layout == LAYOUT_GRID) {
+        if (grid == Py_None || !PyArg_ParseTuple(grid, "ii;grid must be (rows, cols)", &spec->rows, &spec->cols)) {
+            if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "Grid layout requires grid=(rows, cols)");
+            return 0;
+        }
+        if (spec->rows <= 0 || spec->cols <= 0) {
+            PyErr_SetString(PyExc_ValueError, "grid rows and cols must be positive");
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static PyObject *
-camsys_read(PyObject *self, PyObject *args)
+camsys_read(PyObject *self, PyObject *args, PyObject *kwargs)
 {
     pthread_t *threads = NULL;
     CamReadWorkerArgStruct *cam_args = NULL;
+    int held = 0; //Cameras referenced from cam_args, kept alive while the GIL is released
     PyObject *res = NULL;
-    PyObject *camsys, *cams, *pywidth=NULL, *pyheight=NULL, *camobj, *cam=NULL;
-    if (!PyArg_ParseTuple(args, "OO", &camsys, &cams)) return NULL;
+    PyObject *camsys, *cams, *camobj, *cam=NULL, *arr=NULL;
+    char *layout = "nhwc", *dtype = "uint8";
+    PyObject *scale = Py_None, *offset = Py_None, *letterbox = Py_None, *grid = Py_None;
+    int pad = 0;
+    OutputSpec spec;
+    static char *kwlist[] = {"camsys", "cams", "layout", "dtype", "scale", "offset", "letterbox", "pad", "grid", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|ssOOOiO", kwlist, &camsys, &cams,
+                                     &layout, &dtype, &scale, &offset, &letterbox, &pad, &grid))
+        return NULL;
+    if (!parse_output_spec(&spec, layout, dtype, scale, offset, letterbox, pad, grid))
+        return NULL;
         
 //    cams = PyObject_GetAttrString(camsys, "cameras"); //INCREF!
     if (!cams) return NULL;
@@ -189,48 +1074,186 @@ camsys_read(PyObject *self, PyObject *args)
         goto RETURN;
     }
 
-    pywidth = PyObject_GetAttrString(camsys, "width"); //INCREF!
-    if (!pywidth) goto RETURN;
-    pyheight = PyObject_GetAttrString(camsys, "height"); //INCREF!
-    if (!pyheight) goto RETURN;
-    int width = (int) PyLong_AsLong(pywidth);
-    int height = (int) PyLong_AsLong(pyheight);
-    int cam_dst_sz = width * height * 3;
-
-
     threads = (pthread_t *) malloc(N*sizeof(pthread_t));
     cam_args = (CamReadWorkerArgStruct *) malloc(N*sizeof(CamReadWorkerArgStruct));
 
-    npy_intp dims[4] = {N,height, width, 3};
-    PyObject *arr = PyArray_SimpleNew(4, dims, NPY_UINT8); //INCREF!
-    if (!arr)
-        goto RETURN;
-    uint8_t *dst = (uint8_t *) PyArray_DATA((PyArrayObject *) arr);
-
-    for (int i=0; i<N; i++) { //Prepare thread args
+    for (int i=0; i<N; i++) { //Collect cameras
         camobj = PySequence_GetItem(cams, i);
         if (!camobj) goto RETURN;
         cam = PyObject_GetAttrString(camobj, "_v4l2cam");
-        cam_args[i] = (CamReadWorkerArgStruct){(v4l2camObject *) cam, &dst[i * cam_dst_sz], 0};
-        Py_XDECREF(cam);
+        Py_DECREF(camobj);
+        if (!cam) goto RETURN;
+        cam_args[i] = (CamReadWorkerArgStruct){(v4l2camObject *) cam, NULL, &spec, i, 0};
+        held++;
+        if (!cam_args[i].cam->streaming) {
+            PyErr_Format(PyExc_RuntimeError, "Camera %i is not streaming (stopped or paused)", i);
+            goto RETURN;
+        }
+        for (int j=0; j<i; j++) //Workers of one camera would share its scratch buffers
+            if (cam_args[j].cam == cam_args[i].cam) {
+                PyErr_Format(PyExc_ValueError, "Camera %i is the same as camera %i; read each camera once.", i, j);
+                goto RETURN;
+            }
+        if (cam_reading(cam_args[i].cam, "read"))
+            goto RETURN;
+    }
+    //Cameras with equal output share one array; otherwise each gets its own
+    int width, height, cam_width, cam_height, mixed = 0;
+    int channels = cam_args[0].cam->channels, depth = cam_args[0].cam->depth;
+    output_size(cam_args[0].cam, &spec, &width, &height);
+    for (int i=0; i<N; i++) {
+        v4l2camObject *c = cam_args[i].cam;
+        output_size(c, &spec, &cam_width, &cam_height);
+        if (cam_width != width || cam_height != height || c->channels != channels || c->depth != depth) {
+            if (spec.layout != LAYOUT_NHWC) {
+                PyErr_Format(PyExc_ValueError, "Camera %i outputs (%d,%d)x%i but camera 0 outputs (%d,%d)x%i; "
+                             "layout '%s' needs equal outputs.", i, cam_width, cam_height, c->channels,
+                             width, height, channels, layout);
+                goto RETURN;
+            }
+            mixed = 1;
+        }
+        if (c->channels == 1 && (spec.layout != LAYOUT_NHWC || spec.dtype != DTYPE_UINT8 || spec.width > 0)) {
+            PyErr_Format(PyExc_ValueError, "Camera %i gives single-channel output, which supports only "
+                         "layout 'nhwc' without dtype or letterbox.", i);
+            goto RETURN;
+        }
+    }
+    if (mixed) {
+        arr = PyList_New(N);
+        if (!arr) goto RETURN;
+        for (int i=0; i<N; i++) {
+            PyObject *a = new_camera_array(cam_args[i].cam, &spec, &cam_args[i].dst);
+            if (!a) goto RETURN;
+            PyList_SET_ITEM(arr, i, a);
+        }
     }
+    else {
+        size_t cam_dst_sz = (size_t) width * height * channels * depth * output_dtype_size(spec.dtype);
+
+        int typenum = (spec.dtype == DTYPE_FLOAT32 ? NPY_FLOAT32 : (spec.dtype == DTYPE_FLOAT16 ? NPY_FLOAT16 : NPY_UINT8));
+        if (channels == 1 && depth == 2) typenum = NPY_UINT16;
+        npy_intp dims[4] = {N, height, width, 3};
+        if (spec.layout == LAYOUT_NCHW) {
+            dims[1] = 3;
+            dims[2] = height;
+            dims[3] = width;
+        }
+        if (spec.layout == LAYOUT_GRID) { //Every camera writes its own tile of one image
+            if (N > spec.rows * spec.cols) {
+                PyErr_Format(PyExc_ValueError, "A %ix%i grid cannot hold %i cameras.", spec.rows, spec.cols, N);
+                goto RETURN;
+            }
+            cam_dst_sz = 0;
+            image_size(cam_args[0].cam, &spec, &width, &height);
+            dims[0] = height;
+            dims[1] = width;
+            dims[2] = 3;
+        }
+        arr = PyArray_SimpleNew((spec.layout == LAYOUT_GRID || channels == 1) ? 3 : 4, dims, typenum); //INCREF!
+        if (!arr)
+            goto RETURN;
+        uint8_t *dst = (uint8_t *) PyArray_DATA((PyArrayObject *) arr);
+        for (int i=0; i<N; i++) //Prepare thread args
+            cam_args[i].dst = &dst[i * cam_dst_sz];
+        if (spec.layout == LAYOUT_GRID)
+            for (int i=N; i<spec.rows * spec.cols; i++)
+                fill_tile(cam_args[0].cam, &spec, dst, i);
+    }
+    for (int i=0; i<N; i++)
+        cam_args[i].cam->readers++;
+    Py_BEGIN_ALLOW_THREADS //Workers touch no Python objects
     for (int i=0; i<N; i++) //Run threads
         pthread_create(&(threads[i]), NULL, cam_read_worker, (void *)(&cam_args[i]));
     for (int i=0; i<N; i++) 
         pthread_join(threads[i], NULL);
+    Py_END_ALLOW_THREADS
+    for (int i=0; i<N; i++)
+        cam_args[i].cam->readers--;
+    PyObject *lost = PyList_New(0); //Lost cameras are reported together
+    for (int i=0; lost && i<N; i++) {
+        if (cam_args[i].res && IS_DEVICE_LOST(cam_args[i].err)) {
+            PyObject *index = PyLong_FromLong(i);
+            if (!index || PyList_Append(lost, index) < 0) Py_CLEAR(lost);
+            Py_XDECREF(index);
+        }
+    }
+    if (!lost) goto RETURN;
+    if (PyList_GET_SIZE(lost) > 0) {
+        PyObject *value = Py_BuildValue("(sO)", "Camera disconnected", lost);
+        PyErr_SetObject(DeviceLost, value);
+        Py_XDECREF(value);
+        Py_DECREF(lost);
+        goto RETURN;
+    }
+    Py_XDECREF(lost);
     for (int i=0; i<N; i++) { //Check for errors
         if (cam_args[i].res) {
-            PyErr_Format(PyExc_RuntimeError, "Reading image from camera %i failed: %i\n", i, cam_args[i].res);
+            if (cam_args[i].res == 2)
+                PyErr_Format(PyExc_RuntimeError, "Reading image from camera %i failed: %i corrupt frame(s) in a row",
+                             i, cam_args[i].cam->skip_corrupt + 1);
+            else
+                PyErr_Format(PyExc_RuntimeError, "Reading image from camera %i failed: %i\n", i, cam_args[i].res);
             goto RETURN;
         }
     }
 
     res = arr;
+    arr = NULL;
     RETURN:
+    for (int i=0; i<held; i++)
+        Py_DECREF(cam_args[i].cam);
     free(threads);
     free(cam_args);
-    Py_XDECREF(pywidth);
-    Py_XDECREF(pyheight);
+    Py_XDECREF(arr);
+    return res;
+}
+
+static PyObject *
+demosaic(PyObject *module, PyObject *args, PyObject *kwargs)
+{
+    PyObject *pyraw, *res = NULL;
+    PyArrayObject *raw = NULL;
+    char *pattern, *algorithm = "bilinear";
+    uint8_t *argb = NULL, *green = NULL;
+    static char *kwlist[] = {"raw", "pattern", "algorithm", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|s", kwlist, &pyraw, &pattern, &algorithm))
+        return NULL;
+    int bayer = (strlen(pattern) == 4 ? bayer_pattern(STR2FOURCC(pattern)) : -1);
+    int alg = demosaic_algorithm(algorithm);
+    if (bayer < 0) {
+        PyErr_Format(PyExc_ValueError, "`%s` is not a Bayer pattern; use 'RGGB', 'GRBG', 'GBRG' or 'BGGR'", pattern);
+        return NULL;
+    }
+    if (alg < 0 || alg == DEMOSAIC_RAW) {
+        PyErr_Format(PyExc_ValueError, "Unknown demosaic `%s`; use 'nearest', 'bilinear' or 'edge'", algorithm);
+        return NULL;
+    }
+    raw = (PyArrayObject *) PyArray_FROM_OTF(pyraw, NPY_UINT8, NPY_ARRAY_IN_ARRAY);
+    if (!raw) return NULL;
+    if (PyArray_NDIM(raw) != 2) {
+        PyErr_SetString(PyExc_ValueError, "raw must be a 2D uint8 array");
+        goto RETURN;
+    }
+    int height = (int) PyArray_DIM(raw, 0), width = (int) PyArray_DIM(raw, 1);
+    npy_intp dims[3] = {height, width, 3};
+    res = PyArray_SimpleNew(3, dims, NPY_UINT8);
+    if (!res) goto RETURN;
+    argb = malloc((size_t) width * height * 4);
+    green = malloc((size_t) width * height);
+    int err = (!argb || !green);
+    Py_BEGIN_ALLOW_THREADS
+    if (!err) err = demosaic_to_argb(PyArray_DATA(raw), width, width, height, bayer, alg, argb, width*4, green);
+    if (!err) err = ARGBToRAW(argb, width*4, PyArray_DATA((PyArrayObject *) res), width*3, width, height);
+    Py_END_ALLOW_THREADS
+    if (err) {
+        PyErr_Format(PyExc_ValueError, "Demosaic of a (%d,%d) image failed; the size must be even", height, width);
+        Py_CLEAR(res);
+    }
+    RETURN:
+    free(argb);
+    free(green);
+    Py_XDECREF(raw);
     return res;
 }
 
@@ -244,7 +1267,6 @@ is_valid_device(PyObject *module, PyObject *device)
     int res = v4l2_test_valid_device(fd, devicestr);
     close(fd);
     if (res == 0) {
-        PyErr_Clear();
         Py_RETURN_FALSE;
     }
     else
@@ -255,7 +1277,14 @@ is_valid_device(PyObject *module, PyObject *device)
 PyMethodDef v4l2cam_methods[] = {
     {"start",    (PyCFunction)v4l2cam_start,    METH_NOARGS, ""},
     {"stop",     (PyCFunction)v4l2cam_stop,     METH_NOARGS, ""},
+    {"pause",    (PyCFunction)v4l2cam_pause,    METH_NOARGS, "pause(): stop streaming, keeping the device open and buffers mapped"},
+    {"resume",   (PyCFunction)v4l2cam_resume,   METH_NOARGS, "resume(): requeue buffers and restart streaming"},
+    {"reconfigure", (PyCFunction)v4l2cam_reconfigure, METH_VARARGS | METH_KEYWORDS,
+     "reconfigure(size=None, format=None, fps=None): change settings on the open device"},
     {"read",     (PyCFunction)v4l2cam_read,     METH_NOARGS, ""},
+    {"discard",  (PyCFunction)v4l2cam_discard,  METH_NOARGS, "discard(): dequeue and requeue the next frame without converting it; returns its sequence number"},
+    {"set_remap", (PyCFunction)v4l2cam_set_remap, METH_VARARGS, "set_remap(map_x, map_y): remap frames with dense float maps. No arguments disables it."},
+    {"get_controls", (PyCFunction)v4l2cam_get_controls, METH_O, "get_controls(ids): current values of controls"},
     {NULL, NULL, 0, NULL}
 };
 
@@ -265,6 +1294,33 @@ static PyMemberDef v4l2cam_members[] = {
     {"width", T_INT, offsetof(v4l2camObject, width), 0, "image width"},
     {"height", T_INT, offsetof(v4l2camObject, height), 0, "image height"},
     {"fd", T_INT, offsetof(v4l2camObject, fd), 0, "fd"},
+    {"rotation", T_INT, offsetof(v4l2camObject, rotation), READONLY, "clockwise rotation in degrees"},
+    {"out_width", T_INT, offsetof(v4l2camObject, out_width), READONLY, "output image width"},
+    {"out_height", T_INT, offsetof(v4l2camObject, out_height), READONLY, "output image height"},
+    {"channels", T_INT, offsetof(v4l2camObject, channels), READONLY, "output channels"},
+    {"depth", T_INT, offsetof(v4l2camObject, depth), READONLY, "bytes per sample of single-channel output"},
+    {"skip_corrupt", T_INT, offsetof(v4l2camObject, skip_corrupt), 0, "corrupt frames skipped per read before failing"},
+    {"corrupt_frames", T_ULONG, offsetof(v4l2camObject, corrupt_frames), READONLY, "frames found incomplete, undecodable or flagged"},
+    {"skipped_frames", T_ULONG, offsetof(v4l2camObject, skipped_frames), READONLY, "corrupt frames skipped for the next one"},
+    {"error_frames", T_ULONG, offsetof(v4l2camObject, error_frames), READONLY, "frames flagged with V4L2_BUF_FLAG_ERROR"},
+    {"stall_timeout", T_DOUBLE, offsetof(v4l2camObject, stall_timeout), 0, "seconds without frames before the watchdog restarts the stream; 0 auto, <0 off (set before start)"},
+    {"stalls", T_ULONG, offsetof(v4l2camObject, stalls), READONLY, "stalls handled by the watchdog"},
+    {"stall_restarts", T_ULONG, offsetof(v4l2camObject, stall_restarts), READONLY, "stalls handled by STREAMOFF/STREAMON"},
+    {"stall_reopens", T_ULONG, offsetof(v4l2camObject, stall_reopens), READONLY, "stalls handled by reopening the device"},
+    {"sequence", T_UINT, offsetof(v4l2camObject, sequence), READONLY, "driver sequence number of the last frame read"},
+    {"next_sequence", T_LONGLONG, offsetof(v4l2camObject, next_sequence), 0, "the next read passes over frames older than this sequence number; -1 for none, reset by each read"},
+    {"repeat", T_INT, offsetof(v4l2camObject, repeat), 0, "the next read gives the last frame again without dequeuing; reset by each read"},
+    {"keep_last", T_INT, offsetof(v4l2camObject, keep_last), 0, "keep a copy of single-channel frames, so they can be repeated"},
+    {"decimate", T_INT, offsetof(v4l2camObject, decimate), 0, "convert only every decimate-th frame, by sequence number"},
+    {"decimated_frames", T_ULONG, offsetof(v4l2camObject, decimated_frames), READONLY, "frames left out by decimate"},
+    {"repeated_frames", T_ULONG, offsetof(v4l2camObject, repeated_frames), READONLY, "frames given again by repeat"},
+    {"stale_frames", T_ULONG, offsetof(v4l2camObject, stale_frames), READONLY, "frames passed over for next_sequence"},
+    {"timestamp", T_LONGLONG, offsetof(v4l2camObject, timestamp_ns), READONLY, "mid-exposure CLOCK_MONOTONIC time of the last frame read, in ns"},
+    {"timestamp_flags", T_UINT, offsetof(v4l2camObject, tstamp_flags), READONLY, "V4L2_BUF_FLAG_TIMESTAMP_* and TSTAMP_SRC_* of the last frame"},
+    {"hw_timestamp", T_LONGLONG, offsetof(v4l2camObject, hw_timestamp_ns), READONLY, "mid-exposure time of the last frame from the UVC device clock (CLOCK_MONOTONIC ns), 0 if unknown"},
+    {"device_clock_hz", T_DOUBLE, offsetof(v4l2camObject, device_clock_hz), READONLY, "device clock rate fitted from UVC metadata, 0 until known"},
+    {"exposure", T_INT, offsetof(v4l2camObject, exposure), READONLY, "exposure time in 100 us, followed through control events; 0 if unknown"},
+    {"last_stall", T_DOUBLE, offsetof(v4l2camObject, last_stall), READONLY, "CLOCK_MONOTONIC time of the last stall, 0 for none"},
     {NULL}  /* Sentinel */
 };
 
@@ -272,109 +1328,183 @@ static PyMemberDef v4l2cam_members[] = {
 
 
 
-static PyObject *
-get_framerates(int fd, __u32 pixel_format, __u32 width, __u32 height) {
-    PyObject *fpslist = NULL;
-    struct v4l2_frmivalenum fps;
-    memset(&fps,0,sizeof(fps));
-    fps.index = 0;
-    fps.pixel_format = pixel_format;
-    fps.width = width;
-    fps.height = height;
-    float fmin, fmax, fstep;
-    
-    fpslist = PyList_New(0);
-    
-    while (0 == v4l2_xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &fps)) {
-        if (fps.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
-            PyList_Append(fpslist, Py_BuildValue("f", 1.0*fps.discrete.denominator/fps.discrete.numerator));
-            fps.index++;
-        }
-        else {
-            fmin = fps.stepwise.min.denominator/fps.stepwise.min.numerator;
-            fmax = fps.stepwise.max.denominator/fps.stepwise.max.numerator;
-            fstep = fps.stepwise.step.denominator/fps.stepwise.step.numerator;
-            for (unsigned int f=fmin; f<=fmax; f+=fstep)
-                PyList_Append(fpslist, Py_BuildValue("i", f));
-            break;
-        }
+/* Opens a device for capability queries. Returns the fd, or -1 with an
+   exception set; *buf_type is set to the capture buffer type. */
+static int
+open_for_query(PyObject *device, int *buf_type)
+{
+    PyObject *fspath = PyOS_FSPath(device);
+    if (!fspath) return -1;
+    char *devicestr = (char *) PyUnicode_AsUTF8(fspath);
+    int fd = (devicestr ? open(devicestr, O_RDONLY, 0) : -1);
+    int valid = (devicestr ? v4l2_test_valid_device(fd, devicestr) : 0);
+    Py_DECREF(fspath);
+    if (!valid) {
+        if (devicestr) v4l2_raise();
+        if (fd != -1) close(fd);
+        return -1;
     }
-    return fpslist;
+    *buf_type = (valid == 2 ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE);
+    return fd;
 }
 
-
-static PyObject *
-get_framesizes(int fd, struct v4l2_fmtdesc *fmt) {
-    PyObject *fszdict = NULL;
-    struct v4l2_frmsizeenum fsz;
-    memset(&fsz,0,sizeof(fsz));
-    fsz.index = 0;
-    fsz.pixel_format = fmt->pixelformat;
-    fszdict = PyDict_New();
-    PyObject *key = NULL;
-    __u32 h,w;
-    
-    while (0 == v4l2_xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &fsz)) {
-        if (fsz.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-            w = fsz.discrete.width;
-            h = fsz.discrete.height;
-            key = Py_BuildValue("ii", w, h);
-            PyDict_SetItem(fszdict, key, get_framerates(fd, fsz.pixel_format, w,h));
-            fsz.index++;
-        }
-        else {
-            for (w=fsz.stepwise.min_width; w<=fsz.stepwise.max_width; w+=fsz.stepwise.step_width)
-                for (h=fsz.stepwise.min_height; h<=fsz.stepwise.max_height; h+=fsz.stepwise.step_height) {
-                    key = Py_BuildValue("ii", w, h);
-                    PyDict_SetItem(fszdict, key, get_framerates(fd, fsz.pixel_format, w,h));
-                 }
-            break;
-        }
+/* FOURCC as given by enum_formats, case kept (e.g. "pRAA") */
+static int
+parse_fourcc_arg(PyObject *arg, int *fourcc)
+{
+    char code[4] = {' ', ' ', ' ', ' '};
+    Py_ssize_t len;
+    const char *s = PyUnicode_AsUTF8AndSize(arg, &len);
+    if (!s) return -1;
+    if (len < 2 || len > 4) {
+        PyErr_Format(PyExc_ValueError, "`%s` is not a valid FOURCC", s);
+        return -1;
     }
-    return fszdict;
+    memcpy(code, s, len);
+    *fourcc = v4l2_fourcc(code[0], code[1], code[2], code[3]);
+    return 0;
 }
 
+/* enum_formats(device): [(fourcc, description, flags), ...] */
 static PyObject *
-get_formats(PyObject *module, PyObject *device)
+enum_formats(PyObject *module, PyObject *device)
 {
     struct v4l2_fmtdesc fmt;
-
-    PyObject *fmtdict = NULL, *details = NULL;
     char fourcc[] = "xxxx";
+    int buf_type, fd = open_for_query(device, &buf_type);
+    if (fd == -1) return NULL;
+    PyObject *res = PyList_New(0);
 
-    
-    PyObject *fspath = PyOS_FSPath(device);
-    char *devicestr = (char *) PyUnicode_AsUTF8(fspath);
-    int fd = open(devicestr, O_RDONLY, 0);
-    int valid = v4l2_test_valid_device(fd, devicestr);
-    if (!valid) goto return_err;
-
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;   
-    fmt.index = 0;
-    fmtdict = PyDict_New();
-    //Loop formats
-    while (0 == v4l2_xioctl(fd, VIDIOC_ENUM_FMT, &fmt)) {
+    CLEAR(fmt);
+    fmt.type = buf_type;
+    while (res && 0 == v4l2_xioctl(fd, VIDIOC_ENUM_FMT, &fmt)) {
         fmt.index++;
         memcpy(&fourcc, &fmt.pixelformat, 4);
-        details = PyDict_New();
-        
-        PyDict_SetItemString(details, "description", PyUnicode_FromString((char *) fmt.description));
-        PyDict_SetItemString(details, "compressed", PyBool_FromLong((long) (fmt.flags & V4L2_FMT_FLAG_COMPRESSED)));
-        PyDict_SetItemString(details, "emulated", PyBool_FromLong((long) (fmt.flags & V4L2_FMT_FLAG_EMULATED)));
-        
-        PyDict_SetItemString(details, "framesizes", get_framesizes(fd, &fmt));
-        PyDict_SetItemString(fmtdict, fourcc, details);
+        PyObject *item = Py_BuildValue("(ssI)", fourcc, (char *) fmt.description, fmt.flags);
+        if (!item || PyList_Append(res, item) < 0)
+            Py_CLEAR(res);
+        Py_XDECREF(item);
+    }
+    close(fd);
+    return res;
+}
+
+/* enum_framesizes(device, fourcc): [(w, h), ...] for discrete sizes, or one
+   ("stepwise"|"continuous", min_w, max_w, step_w, min_h, max_h, step_h) */
+static PyObject *
+enum_framesizes(PyObject *module, PyObject *args)
+{
+    PyObject *device, *format;
+    struct v4l2_frmsizeenum fsz;
+    int fourcc, buf_type, fd;
+    if (!PyArg_ParseTuple(args, "OU", &device, &format) || parse_fourcc_arg(format, &fourcc) < 0)
+        return NULL;
+    if ((fd = open_for_query(device, &buf_type)) == -1)
+        return NULL;
+    PyObject *res = PyList_New(0);
+
+    CLEAR(fsz);
+    fsz.pixel_format = fourcc;
+    while (res && 0 == v4l2_xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &fsz)) {
+        PyObject *item;
+        if (fsz.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+            item = Py_BuildValue("(II)", fsz.discrete.width, fsz.discrete.height);
+        else
+            item = Py_BuildValue("(sIIIIII)", (fsz.type == V4L2_FRMSIZE_TYPE_STEPWISE ? "stepwise" : "continuous"),
+                                 fsz.stepwise.min_width, fsz.stepwise.max_width, fsz.stepwise.step_width,
+                                 fsz.stepwise.min_height, fsz.stepwise.max_height, fsz.stepwise.step_height);
+        if (!item || PyList_Append(res, item) < 0)
+            Py_CLEAR(res);
+        Py_XDECREF(item);
+        if (fsz.type != V4L2_FRMSIZE_TYPE_DISCRETE) break; //Only index 0 is valid
+        fsz.index++;
+    }
+    close(fd);
+    return res;
+}
+
+/* enum_frameintervals(device, fourcc, (w, h)): [(num, den), ...] for discrete
+   intervals, or one ("stepwise"|"continuous", (num, den) min, max, step) */
+static PyObject *
+enum_frameintervals(PyObject *module, PyObject *args)
+{
+    PyObject *device, *format;
+    struct v4l2_frmivalenum fiv;
+    unsigned int width, height;
+    int fourcc, buf_type, fd;
+    if (!PyArg_ParseTuple(args, "OU(II)", &device, &format, &width, &height) || parse_fourcc_arg(format, &fourcc) < 0)
+        return NULL;
+    if ((fd = open_for_query(device, &buf_type)) == -1)
+        return NULL;
+    PyObject *res = PyList_New(0);
+
+    CLEAR(fiv);
+    fiv.pixel_format = fourcc;
+    fiv.width = width;
+    fiv.height = height;
+    while (res && 0 == v4l2_xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &fiv)) {
+        PyObject *item;
+        if (fiv.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+            item = Py_BuildValue("(II)", fiv.discrete.numerator, fiv.discrete.denominator);
+        else
+            item = Py_BuildValue("(s(II)(II)(II))", (fiv.type == V4L2_FRMIVAL_TYPE_STEPWISE ? "stepwise" : "continuous"),
+                                 fiv.stepwise.min.numerator, fiv.stepwise.min.denominator,
+                                 fiv.stepwise.max.numerator, fiv.stepwise.max.denominator,
+                                 fiv.stepwise.step.numerator, fiv.stepwise.step.denominator);
+        if (!item || PyList_Append(res, item) < 0)
+            Py_CLEAR(res);
+        Py_XDECREF(item);
+        if (fiv.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+        fiv.index++;
     }
-    if (!PyErr_Occurred())
-        return fmtdict;
-    
-    
-    return_err:
     close(fd);
-    Py_XDECREF(fmtdict);
-    return NULL;    
+    return res;
 }
 
+/* enum_controls(device): [(id, name, type, minimum, maximum, step, default,
+   flags, menu)], menu being [(index, name or value)] for menu controls and
+   None otherwise. Disabled controls and class headers are left out. */
+static PyObject *
+enum_controls(PyObject *module, PyObject *device)
+{
+    struct v4l2_queryctrl qc;
+    struct v4l2_querymenu qm;
+    int buf_type, fd = open_for_query(device, &buf_type);
+    if (fd == -1) return NULL;
+    PyObject *res = PyList_New(0);
+
+    CLEAR(qc);
+    qc.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+    while (res && 0 == v4l2_xioctl(fd, VIDIOC_QUERYCTRL, &qc)) {
+        if (!(qc.flags & V4L2_CTRL_FLAG_DISABLED) && qc.type != V4L2_CTRL_TYPE_CTRL_CLASS) {
+            PyObject *menu = Py_None;
+            Py_INCREF(menu);
+            if (qc.type == V4L2_CTRL_TYPE_MENU || qc.type == V4L2_CTRL_TYPE_INTEGER_MENU) {
+                Py_DECREF(menu);
+                menu = PyList_New(0);
+                for (int i = qc.minimum; menu && i <= qc.maximum; i++) {
+                    CLEAR(qm);
+                    qm.id = qc.id;
+                    qm.index = i;
+                    if (-1 == v4l2_xioctl(fd, VIDIOC_QUERYMENU, &qm)) continue; //Gaps are allowed
+                    PyObject *entry = (qc.type == V4L2_CTRL_TYPE_MENU ? Py_BuildValue("(is)", i, (char *) qm.name)
+                                                                     : Py_BuildValue("(iL)", i, (long long) qm.value));
+                    if (!entry || PyList_Append(menu, entry) < 0)
+                        Py_CLEAR(menu);
+                    Py_XDECREF(entry);
+                }
+            }
+            PyObject *item = (menu ? Py_BuildValue("(IsiiiiiIN)", qc.id, (char *) qc.name, qc.type, qc.minimum,
+                                                   qc.maximum, qc.step, qc.default_value, qc.flags, menu) : NULL);
+            if (!item || PyList_Append(res, item) < 0)
+                Py_CLEAR(res);
+            Py_XDECREF(item);
+        }
+        qc.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    }
+    close(fd);
+    return res;
+}
 
 static PyTypeObject v4l2camType = {
     PyVarObject_HEAD_INIT(NULL, 0)
@@ -390,9 +1520,16 @@ static PyTypeObject v4l2camType = {
 };
 
 static PyMethodDef v4l2camMethods[] = {
-    {"camsys_read",     (PyCFunction)camsys_read,     METH_VARARGS, NULL},
+    {"camsys_start",    (PyCFunction)camsys_start,    METH_O,       "camsys_start(cams): start v4l2cam objects concurrently"},
+    {"camsys_read",     (PyCFunction)camsys_read,     METH_VARARGS | METH_KEYWORDS, NULL},
     {"is_valid_device", (PyCFunction)is_valid_device, METH_O,       NULL},
-    {"get_formats",     (PyCFunction)get_formats,     METH_O,       NULL},
+    {"enum_formats",    (PyCFunction)enum_formats,    METH_O,       "enum_formats(device): [(fourcc, description, flags)]"},
+    {"enum_framesizes", (PyCFunction)enum_framesizes, METH_VARARGS, "enum_framesizes(device, fourcc): [(w, h)] or [(type, min_w, max_w, step_w, min_h, max_h, step_h)]"},
+    {"enum_frameintervals", (PyCFunction)enum_frameintervals, METH_VARARGS, "enum_frameintervals(device, fourcc, (w, h)): [(num, den)] or [(type, min, max, step)]"},
+    {"enum_controls",   (PyCFunction)enum_controls,   METH_O,       "enum_controls(device): [(id, name, type, min, max, step, default, flags, menu)]"},
+    {"camsys_set_controls", (PyCFunction)camsys_set_controls, METH_VARARGS,
+     "camsys_set_controls(cams, controls): set [(id, value)] per camera, in parallel, all or none"},
+    {"demosaic",        (PyCFunction)demosaic,        METH_VARARGS | METH_KEYWORDS, "demosaic(raw, pattern, algorithm='bilinear'): 8-bit Bayer image to RGB"},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -424,5 +1561,15 @@ PyInit_backend(void)
         return NULL;
     }
 
+    //DeviceLost(message, [camera indices])
+    DeviceLost = PyErr_NewException("multicam.backend.DeviceLost", PyExc_RuntimeError, NULL);
+    Py_XINCREF(DeviceLost);
+    if (PyModule_AddObject(m, "DeviceLost", DeviceLost) < 0) {
+        Py_XDECREF(DeviceLost);
+        Py_CLEAR(DeviceLost);
+        Py_DECREF(m);
+        return NULL;
+    }
+
     return m;
 }
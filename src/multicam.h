@@ -1,5 +1,17 @@
 #ifndef MULTICAM_H
 #define MULTICAM_H
+#include <pthread.h>
+#include <stdint.h>
+/* Planes per buffer with the multi-planar API */
+#define MAX_PLANES 3
+
+/* Output mirroring, applied after rotation */
+#define FLIP_H 1
+#define FLIP_V 2
+
+struct RemapLUT;
+struct UvcMeta;
+
 struct buffer {
     void * start;
     size_t length;
@@ -10,13 +22,66 @@ typedef struct v4l2camObject {
 //    PyObject *device;
     char* device;
     char* format;
-    struct buffer* buffers;
+    struct buffer* buffers; /* Plane p of buffer i at [i*n_planes + p] */
     unsigned int n_buffers;
+    unsigned int n_planes;
+    int buf_type;           /* V4L2_BUF_TYPE_VIDEO_CAPTURE or _MPLANE */
+    int streaming;          /* Between STREAMON and STREAMOFF */
+    int plane_stride[MAX_PLANES];
     int width;
     int height;
     float fps;
     int fd;
     int fourcc;
+    int bytesperline;
+    unsigned int sizeimage; /* Bytes of a complete frame (plane 0), from VIDIOC_S_FMT */
+    int rotation;
+    int flip;
+    int bayer;      /* Bayer pattern, -1 for other formats */
+    int demosaic;
+    int mono;       /* High bit depth greyscale/depth format, -1 for others */
+    int channels;   /* 3 for RGB, 1 for raw passthrough and mono */
+    int depth;      /* Bytes per sample of single-channel output */
+    int out_width;
+    int out_height;
+    struct buffer argb;   /* Conversion scratch, kept between frames */
+    struct buffer scaled;
+    struct buffer rgb;
+    struct buffer remapped;
+    struct buffer rotated;
+    struct buffer green;
+    struct RemapLUT *remap;
+    int skip_corrupt;     /* Corrupt frames skipped per read before failing */
+    unsigned long corrupt_frames; /* Incomplete, undecodable or flagged by the driver */
+    unsigned long skipped_frames;
+    int64_t next_sequence;    /* Older frames are passed over by the next read; -1 for none */
+    uint32_t sequence;        /* Sequence number of the last frame read */
+    unsigned long stale_frames; /* Frames passed over for next_sequence */
+    int repeat;               /* The next read gives the last frame again, without dequeuing */
+    int keep_last;            /* Keep a copy of single-channel output for repeat */
+    struct buffer last_raw;   /* That copy */
+    unsigned long repeated_frames;
+    int decimate;             /* Only every decimate-th frame is converted */
+    int64_t next_keep;        /* Sequence number of the next frame decimation keeps */
+    unsigned long decimated_frames;
+    int readers;              /* Reads in progress without the GIL; changed only with the GIL held */
+    unsigned long error_frames;   /* Flagged with V4L2_BUF_FLAG_ERROR */
+    pthread_mutex_t io_lock;  /* Held for device I/O, never while waiting for a frame */
+    double stall_timeout;     /* Seconds without frames before a restart; 0 auto, <0 off */
+    int64_t last_frame_ns;    /* CLOCK_MONOTONIC of the last sign of life */
+    int stall_level;          /* Restarts since the last frame */
+    unsigned long stalls;
+    unsigned long stall_restarts; /* STREAMOFF/STREAMON cycles */
+    unsigned long stall_reopens;  /* Full close and reopen */
+    double last_stall;        /* CLOCK_MONOTONIC seconds of the last stall, 0 for none */
+    int recovering;           /* The watchdog is restarting it; changed only under the watchdog's lock */
+    int exposure;             /* V4L2_CID_EXPOSURE_ABSOLUTE in 100 us, 0 if unknown */
+    int exposure_events;      /* Subscribed to its change events */
+    int64_t timestamp_ns;     /* Mid-exposure CLOCK_MONOTONIC time of the last frame read */
+    uint32_t tstamp_flags;    /* Timestamp type and source flags of the last frame */
+    struct UvcMeta *meta;     /* Paired UVC metadata node, or NULL */
+    int64_t hw_timestamp_ns;  /* Mid-exposure time from the device clock, 0 if unknown */
+    double device_clock_hz;   /* Device clock rate estimated from the metadata */
 } v4l2camObject;
 
 #endif //MULTICAM_H
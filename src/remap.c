@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "remap.h"
+
+/*
+ * Precomputed remapping (lens undistortion, rectification) of ARGB frames.
+ * Dense float maps are converted once to 16-bit integer positions with 7-bit
+ * bilinear weights, stored in output tile order so each tile reads its part
+ * of the LUT sequentially and its source pixels from a small region.
+*/
+
+/* Splits a source coordinate into a base index in [0, n-2] and a weight in [0, 128] */
+static int
+fixed_coord(float v, int n, uint16_t *base, uint8_t *weight)
+{
+    if (!(v >= 0.0f && v <= (float) (n-1))) //Also rejects NaN
+        return 0;
+    int i = (int) floorf(v);
+    int a = (int) lrintf((v - i) * 128.0f);
+    if (a == 128) {
+        i++;
+        a = 0;
+    }
+    if (i > n-2) { //Last row/column: interpolate fully towards it
+        i = n-2;
+        a = 128;
+    }
+    *base = (uint16_t) i;
+    *weight = (uint8_t) a;
+    return 1;
+}
+
+RemapLUT *
+remap_create(const float *map_x, const float *map_y, int width, int height, int src_width, int src_height)
+{
+    if (width <= 0 || height <= 0 || src_width < 2 || src_height < 2 || src_width >= REMAP_INVALID || src_height >= REMAP_INVALID)
+        return NULL;
+    RemapLUT *lut = malloc(sizeof(RemapLUT));
+    if (!lut) return NULL;
+    lut->pixels = malloc((size_t) width * height * sizeof(RemapPixel));
+    if (!lut->pixels) {
+        free(lut);
+        return NULL;
+    }
+    lut->width = width;
+    lut->height = height;
+    lut->src_width = src_width;
+    lut->src_height = src_height;
+
+    RemapPixel *p = lut->pixels;
+    for (int y0=0; y0<height; y0+=REMAP_TILE_H)
+        for (int x0=0; x0<width; x0+=REMAP_TILE_W)
+            for (int y=y0; y<y0+REMAP_TILE_H && y<height; y++)
+                for (int x=x0; x<x0+REMAP_TILE_W && x<width; x++, p++) {
+                    size_t i = (size_t) y*width + x;
+                    if (!fixed_coord(map_x[i], src_width, &p->x, &p->ax) ||
+                        !fixed_coord(map_y[i], src_height, &p->y, &p->ay)) {
+                        p->x = REMAP_INVALID;
+                        p->y = 0;
+                        p->ax = p->ay = 0;
+                    }
+                }
+    return lut;
+}
+
+void
+remap_free(RemapLUT *lut)
+{
+    if (!lut) return;
+    free(lut->pixels);
+    free(lut);
+}
+
+/* Bilinear sample of 2x2 ARGB pixels at s, with weights out of 128 */
+static inline void
+bilinear_argb(const uint8_t *s, int stride, int ax, int ay, uint8_t *d)
+{
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    int32_t top32[2], bot32[2];
+    memcpy(top32, s, 8);
+    memcpy(bot32, s + stride, 8);
+    __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) top32), zero);
+    __m128i bot = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) bot32), zero);
+    //Pair up the left and right neighbour of each channel
+    top = _mm_unpacklo_epi16(top, _mm_srli_si128(top, 8));
+    bot = _mm_unpacklo_epi16(bot, _mm_srli_si128(bot, 8));
+    __m128i wx = _mm_set1_epi32((ax << 16) | (128 - ax));
+    __m128i h = _mm_packs_epi32(_mm_madd_epi16(top, wx), _mm_madd_epi16(bot, wx)); //<= 255*128
+    h = _mm_unpacklo_epi16(h, _mm_srli_si128(h, 8));
+    __m128i wy = _mm_set1_epi32((ay << 16) | (128 - ay));
+    __m128i v = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(h, wy), _mm_set1_epi32(8192)), 14);
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    int32_t out = _mm_cvtsi128_si32(v);
+    memcpy(d, &out, 4);
+#else
+    int w00 = (128-ax)*(128-ay), w01 = ax*(128-ay), w10 = (128-ax)*ay, w11 = ax*ay;
+    for (int c=0; c<4; c++)
+        d[c] = (uint8_t) ((s[c]*w00 + s[4+c]*w01 + s[stride+c]*w10 + s[stride+4+c]*w11 + 8192) >> 14);
+#endif
+}
+
+/* Remaps the tile whose top-left output pixel is (x0,y0) into dst.
+   src_stride may be negative for a vertically flipped source. */
+void
+remap_tile(const RemapLUT *lut, int x0, int y0, const uint8_t *src, int src_stride, uint8_t pad,
+           uint8_t *dst, int dst_stride)
+{
+    int tw = (lut->width - x0 < REMAP_TILE_W ? lut->width - x0 : REMAP_TILE_W);
+    int th = (lut->height - y0 < REMAP_TILE_H ? lut->height - y0 : REMAP_TILE_H);
+    //Tiles are stored in order; all but the last row of tiles are full height
+    const RemapPixel *p = lut->pixels + (size_t) y0*lut->width + (size_t) x0*th;
+    for (int y=0; y<th; y++) {
+        uint8_t *d = dst + (ptrdiff_t) y*dst_stride;
+        for (int x=0; x<tw; x++, p++, d+=4) {
+            if (p->x == REMAP_INVALID) {
+                d[0] = d[1] = d[2] = pad;
+                d[3] = 255;
+                continue;
+            }
+            bilinear_argb(src + (ptrdiff_t) p->y*src_stride + p->x*4, src_stride, p->ax, p->ay, d);
+        }
+    }
+}
+
+void
+remap_image(const RemapLUT *lut, const uint8_t *src, int src_stride, uint8_t pad, uint8_t *dst, int dst_stride)
+{
+    for (int y0=0; y0<lut->height; y0+=REMAP_TILE_H)
+        for (int x0=0; x0<lut->width; x0+=REMAP_TILE_W)
+            remap_tile(lut, x0, y0, src, src_stride, pad, dst + (ptrdiff_t) y0*dst_stride + x0*4, dst_stride);
+}
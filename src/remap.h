@@ -0,0 +1,29 @@
+#ifndef REMAP_H
+#define REMAP_H
+#include <stdint.h>
+
+/* Output is produced in tiles of this size; the LUT is stored tile by tile */
+#define REMAP_TILE_W 64
+#define REMAP_TILE_H 8
+#define REMAP_INVALID 0xffff
+
+/* Source position of one output pixel: top-left neighbour and 0..128 weights */
+typedef struct RemapPixel {
+    uint16_t x, y;
+    uint8_t ax, ay;
+} RemapPixel;
+
+typedef struct RemapLUT {
+    int width;       /* Output size */
+    int height;
+    int src_width;   /* Size of the frames it samples from */
+    int src_height;
+    RemapPixel *pixels;
+} RemapLUT;
+
+RemapLUT *remap_create(const float *map_x, const float *map_y, int width, int height, int src_width, int src_height);
+void remap_free(RemapLUT *lut);
+void remap_tile(const RemapLUT *lut, int x0, int y0, const uint8_t *src, int src_stride, uint8_t pad,
+                uint8_t *dst, int dst_stride);
+void remap_image(const RemapLUT *lut, const uint8_t *src, int src_stride, uint8_t pad, uint8_t *dst, int dst_stride);
+#endif //REMAP_H
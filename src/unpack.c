@@ -0,0 +1,118 @@
+#include <stddef.h>
+#include <string.h>
+#include <linux/videodev2.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define HAVE_SSSE3_KERNELS
+#endif
+#include "unpack.h"
+
+/*
+ * Unpacking of high bit depth greyscale and depth formats to uint16.
+ * The packed 10-bit formats have SSSE3 kernels, chosen at run time.
+*/
+
+#ifndef V4L2_PIX_FMT_Y10P
+#define V4L2_PIX_FMT_Y10P v4l2_fourcc('Y', '1', '0', 'P')
+#endif
+
+int mono16_format(uint32_t fourcc)
+{
+    switch (fourcc) {
+        case V4L2_PIX_FMT_Y10:
+        case V4L2_PIX_FMT_Y12:
+        case V4L2_PIX_FMT_Y14:
+        case V4L2_PIX_FMT_Y16:
+        case V4L2_PIX_FMT_Z16: return MONO16_PLAIN;
+        case V4L2_PIX_FMT_Y10P: return MONO16_Y10P;
+        case V4L2_PIX_FMT_Y10BPACK: return MONO16_Y10BPACK;
+        default: return -1;
+    }
+}
+
+/* Bytes needed for one row of `width` pixels */
+int mono16_min_stride(int format, int width)
+{
+    return (format == MONO16_PLAIN ? width*2 : (width*10 + 7)/8);
+}
+
+static void
+unpack_y10p_row(const uint8_t *src, uint16_t *dst, int width)
+{
+    for (int x=0; x<width; x++) {
+        const uint8_t *g = src + (x/4)*5;
+        dst[x] = (uint16_t) ((g[x%4] << 2) | ((g[4] >> (2*(x%4))) & 3));
+    }
+}
+
+static void
+unpack_y10bpack_row(const uint8_t *src, uint16_t *dst, int width)
+{
+    for (int x=0; x<width; x++) {
+        const uint8_t *g = src + (x/4)*5 + x%4;
+        int shift = 6 - 2*(x%4);
+        dst[x] = (uint16_t) ((((g[0] << 8) | g[1]) >> shift) & 0x3ff);
+    }
+}
+
+#ifdef HAVE_SSSE3_KERNELS
+/* 8 pixels (two 5-byte groups) per step; each step loads 16 bytes */
+__attribute__((target("ssse3"))) static int
+unpack_y10p_row_ssse3(const uint8_t *src, uint16_t *dst, int width)
+{
+    const __m128i hi_idx = _mm_setr_epi8(0,-1, 1,-1, 2,-1, 3,-1, 5,-1, 6,-1, 7,-1, 8,-1);
+    const __m128i lo_idx = _mm_setr_epi8(4,-1, 4,-1, 4,-1, 4,-1, 9,-1, 9,-1, 9,-1, 9,-1);
+    const __m128i lo_mul = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1); //Shift by 6-2k, then >>6
+    const __m128i three = _mm_set1_epi16(3);
+    int x = 0;
+    for (; x+8 <= width && (x/4)*5 + 16 <= (width*10 + 7)/8; x+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + (x/4)*5));
+        __m128i hi = _mm_slli_epi16(_mm_shuffle_epi8(v, hi_idx), 2);
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(v, lo_idx), lo_mul), 6);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_or_si128(hi, _mm_and_si128(lo, three)));
+    }
+    return x;
+}
+
+__attribute__((target("ssse3"))) static int
+unpack_y10bpack_row_ssse3(const uint8_t *src, uint16_t *dst, int width)
+{
+    //Big-endian word of bytes k and k+1 of each group, for k = 0..3
+    const __m128i idx = _mm_setr_epi8(1,0, 2,1, 3,2, 4,3, 6,5, 7,6, 8,7, 9,8);
+    const __m128i mul = _mm_setr_epi16(1, 4, 16, 64, 1, 4, 16, 64); //(w << 2k) >> 6 == (w >> 6-2k) & 0x3ff
+    int x = 0;
+    for (; x+8 <= width && (x/4)*5 + 16 <= (width*10 + 7)/8; x+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + (x/4)*5));
+        __m128i w = _mm_mullo_epi16(_mm_shuffle_epi8(v, idx), mul);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_srli_epi16(w, 6));
+    }
+    return x;
+}
+#endif
+
+/* dst_stride is in pixels and may be negative to flip the image */
+void unpack_mono16(const uint8_t *src, int src_stride, int width, int height, int format,
+                   uint16_t *dst, int dst_stride)
+{
+#ifdef HAVE_SSSE3_KERNELS
+    int ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+    for (int y=0; y<height; y++) {
+        const uint8_t *s = src + (ptrdiff_t) y*src_stride;
+        uint16_t *d = dst + (ptrdiff_t) y*dst_stride;
+        int x = 0;
+        if (format == MONO16_PLAIN) {
+            memcpy(d, s, (size_t) width*2);
+            continue;
+        }
+#ifdef HAVE_SSSE3_KERNELS
+        if (ssse3)
+            x = (format == MONO16_Y10P ? unpack_y10p_row_ssse3(s, d, width) : unpack_y10bpack_row_ssse3(s, d, width));
+#endif
+        //Remainder; x is a multiple of 4, i.e. on a group boundary
+        if (format == MONO16_Y10P)
+            unpack_y10p_row(s + (x/4)*5, d + x, width - x);
+        else
+            unpack_y10bpack_row(s + (x/4)*5, d + x, width - x);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef UNPACK_H
+#define UNPACK_H
+#include <stdint.h>
+
+/* Single-channel formats delivered as uint16 */
+#define MONO16_PLAIN    0 /* Y10, Y12, Y14, Y16, Z16: little-endian 16-bit words */
+#define MONO16_Y10P     1 /* MIPI RAW10: 4 pixels in 5 bytes, low bits last */
+#define MONO16_Y10BPACK 2 /* Big-endian 10-bit bit stream */
+
+int mono16_format(uint32_t fourcc);
+int mono16_min_stride(int format, int width);
+void unpack_mono16(const uint8_t *src, int src_stride, int width, int height, int format,
+                   uint16_t *dst, int dst_stride);
+#endif //UNPACK_H
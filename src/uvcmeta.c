@@ -0,0 +1,263 @@
+#include <Python.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include "v4l2.h"
+#include "uvcmeta.h"
+
+/*
+ * UVC metadata nodes. uvcvideo registers a V4L2_BUF_TYPE_META_CAPTURE node
+ * next to each capture node, whose buffers hold the payload headers of the
+ * matching video frame (format UVCH), each as a struct uvc_meta_buf:
+ *   u64 ns      host CLOCK_MONOTONIC time the payload arrived
+ *   u16 sof     host USB frame number at that time
+ *   u8  length  header length, counting itself and flags
+ *   u8  flags   bmHeaderInfo; then PTS (4 bytes) if bit 2, SCR (4 bytes STC,
+ *               2 bytes device SOF) if bit 3
+ * SCR samples the device clock at a USB SOF. The host time of that SOF is
+ * the arrival time less the SOF frames (1 ms each) elapsed since, which
+ * takes out most of the USB latency. One sample is taken per frame, so
+ * the window spans a couple of seconds, and a least squares fit over it
+ * maps device clock to host time. The frame's PTS, the device time its
+ * exposure started, is mapped through the fit.
+*/
+
+#define UVC_STREAM_PTS 0x04
+#define UVC_STREAM_SCR 0x08
+#define META_BUFFERS 8
+#define SOF_MASK 0x7ff /* 11-bit USB frame number */
+
+static uint32_t get_le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24; }
+static uint16_t get_le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+/* Device clock with 32-bit wraparound undone, relative to the last STC */
+static int64_t
+unwrap(const UvcClock *c, uint32_t ticks)
+{
+    int64_t t = c->stc_base + ticks;
+    int64_t last = c->stc_base + c->last_stc;
+    if (t - last > 0x80000000LL) t -= 0x100000000LL;
+    else if (last - t > 0x80000000LL) t += 0x100000000LL;
+    return t;
+}
+
+static void
+clock_sample(UvcClock *c, uint32_t stc, int64_t host_ns)
+{
+    if (!c->started) {
+        c->stc_base = 0;
+        c->x0 = stc;
+        c->y0 = host_ns;
+        c->started = 1;
+    }
+    else if (stc < c->last_stc && c->last_stc - stc > 0x80000000u) {
+        c->stc_base += 0x100000000LL;
+    }
+    c->last_stc = stc;
+    c->x[c->head] = (double) (c->stc_base + stc - c->x0);
+    c->y[c->head] = (double) (host_ns - c->y0);
+    c->head = (c->head + 1) % UVC_CLOCK_WINDOW;
+    if (c->n < UVC_CLOCK_WINDOW) c->n++;
+    if (c->n < UVC_CLOCK_MIN_SAMPLES) return;
+
+    double mx = 0, my = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < c->n; i++) {
+        mx += c->x[i];
+        my += c->y[i];
+    }
+    mx /= c->n;
+    my /= c->n;
+    for (int i = 0; i < c->n; i++) {
+        sxx += (c->x[i] - mx) * (c->x[i] - mx);
+        sxy += (c->x[i] - mx) * (c->y[i] - my);
+    }
+    if (sxx <= 0) return;
+    c->slope = sxy / sxx;
+    c->offset = my - c->slope * mx;
+    c->valid = (c->slope > 0);
+}
+
+/* Feeds the first clock sample of one metadata buffer to the model; returns
+   the first PTS found, or -1 */
+static int64_t
+parse_buffer(UvcClock *c, const uint8_t *data, size_t size)
+{
+    int64_t pts = -1;
+    int sampled = 0;
+    size_t i = 0;
+    while (i + 12 <= size) {
+        int64_t ns;
+        memcpy(&ns, data + i, 8);
+        uint16_t host_sof = get_le16(data + i + 8);
+        uint8_t length = data[i + 10], flags = data[i + 11];
+        if (length < 2 || i + 10 + length > size) break;
+        const uint8_t *header = data + i + 12;
+        size_t n = length - 2, off = 0;
+        if ((flags & UVC_STREAM_PTS) && off + 4 <= n) {
+            if (pts < 0) pts = get_le32(header + off);
+            off += 4;
+        }
+        if ((flags & UVC_STREAM_SCR) && off + 6 <= n && !sampled) {
+            uint32_t stc = get_le32(header + off);
+            uint16_t dev_sof = get_le16(header + off + 4) & SOF_MASK;
+            int elapsed = (host_sof - dev_sof) & SOF_MASK;
+            clock_sample(c, stc, ns - (int64_t) elapsed * 1000000);
+            sampled = 1;
+        }
+        i += 10 + length;
+    }
+    return pts;
+}
+
+UvcMeta *uvcmeta_new(const char *device)
+{
+    UvcMeta *m = calloc(1, sizeof(UvcMeta));
+    if (m) m->device = strdup(device);
+    if (!m || !m->device) {
+        free(m);
+        return NULL;
+    }
+    m->fd = -1;
+    return m;
+}
+
+/* Opens the node, maps its buffers and starts streaming */
+int uvcmeta_start(UvcMeta *m)
+{
+    struct v4l2_capability cap;
+    struct v4l2_format fmt;
+    struct v4l2_requestbuffers req;
+
+    memset(&m->clock, 0, sizeof(m->clock));
+    for (int i = 0; i < UVC_META_FRAMES; i++) m->pts[i] = -1;
+    m->fd = open(m->device, O_RDWR | O_NONBLOCK, 0);
+    if (m->fd == -1) {
+        v4l2_error(PyExc_SystemError, "Cannot open '%s': %d, %s", m->device, errno, strerror(errno));
+        return 0;
+    }
+    memset(&cap, 0, sizeof(cap));
+    if (-1 == v4l2_xioctl(m->fd, VIDIOC_QUERYCAP, &cap) || !(cap.device_caps & V4L2_CAP_META_CAPTURE)) {
+        v4l2_error(PyExc_ValueError, "%s is not a metadata capture device", m->device);
+        goto fail;
+    }
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_META_CAPTURE;
+    fmt.fmt.meta.dataformat = V4L2_META_FMT_UVC;
+    if (-1 == v4l2_xioctl(m->fd, VIDIOC_S_FMT, &fmt) || fmt.fmt.meta.dataformat != V4L2_META_FMT_UVC) {
+        v4l2_error(PyExc_ValueError, "%s does not offer UVC payload header metadata", m->device);
+        goto fail;
+    }
+    memset(&req, 0, sizeof(req));
+    req.count = META_BUFFERS;
+    req.type = V4L2_BUF_TYPE_META_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (-1 == v4l2_xioctl(m->fd, VIDIOC_REQBUFS, &req) || req.count < 1) {
+        v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_REQBUFS) failure : %d, %s", m->device, errno, strerror(errno));
+        goto fail;
+    }
+    m->buffers = calloc(req.count, sizeof(*m->buffers));
+    if (!m->buffers) {
+        v4l2_error(PyExc_MemoryError, "Out of memory");
+        goto fail;
+    }
+    for (m->n_buffers = 0; m->n_buffers < req.count; m->n_buffers++) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_META_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = m->n_buffers;
+        if (-1 == v4l2_xioctl(m->fd, VIDIOC_QUERYBUF, &buf)) {
+            v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_QUERYBUF) failure : %d, %s", m->device, errno, strerror(errno));
+            goto fail;
+        }
+        struct buffer *b = &m->buffers[m->n_buffers];
+        b->length = buf.length;
+        b->start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, buf.m.offset);
+        if (b->start == MAP_FAILED) {
+            b->start = NULL;
+            v4l2_error(PyExc_MemoryError, "%s: mmap failure : %d, %s", m->device, errno, strerror(errno));
+            goto fail;
+        }
+        if (-1 == v4l2_xioctl(m->fd, VIDIOC_QBUF, &buf)) {
+            m->n_buffers++;
+            v4l2_error(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_QBUF) failure : %d, %s", m->device, errno, strerror(errno));
+            goto fail;
+        }
+    }
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_META_CAPTURE;
+    if (-1 == v4l2_xioctl(m->fd, VIDIOC_STREAMON, &type)) {
+        v4l2_error(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_STREAMON) failure : %d, %s", m->device, errno, strerror(errno));
+        goto fail;
+    }
+    return 1;
+
+    fail:
+    uvcmeta_stop(m);
+    return 0;
+}
+
+/* Stops streaming and releases buffers and fd; errors are ignored, as the
+   node may be gone along with its camera */
+void uvcmeta_stop(UvcMeta *m)
+{
+    if (m->fd == -1) return;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_META_CAPTURE;
+    v4l2_xioctl(m->fd, VIDIOC_STREAMOFF, &type);
+    for (unsigned int i = 0; i < m->n_buffers; i++)
+        if (m->buffers[i].start) munmap(m->buffers[i].start, m->buffers[i].length);
+    free(m->buffers);
+    m->buffers = NULL;
+    m->n_buffers = 0;
+    close(m->fd);
+    m->fd = -1;
+}
+
+void uvcmeta_free(UvcMeta *m)
+{
+    if (!m) return;
+    uvcmeta_stop(m);
+    free(m->device);
+    free(m);
+}
+
+/* Drains the metadata queue, feeding every buffer to the clock model, and
+   returns the host time (ns, CLOCK_MONOTONIC) of the PTS of the video frame
+   with `sequence`, or 0 if it has none or the model is not ready yet.
+   uvcvideo gives a frame's metadata buffer the frame's sequence number and
+   completes it just before the frame. */
+int64_t uvcmeta_frame_time(UvcMeta *m, uint32_t sequence)
+{
+    int64_t pts = -1;
+    if (m->fd == -1) return 0;
+    for (;;) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_META_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (-1 == v4l2_xioctl(m->fd, VIDIOC_DQBUF, &buf))
+            break;
+        if (buf.index < m->n_buffers) {
+            const struct buffer *b = &m->buffers[buf.index];
+            size_t size = (buf.bytesused <= b->length ? buf.bytesused : b->length);
+            int slot = buf.sequence % UVC_META_FRAMES;
+            m->sequence[slot] = buf.sequence;
+            m->pts[slot] = parse_buffer(&m->clock, b->start, size);
+        }
+        v4l2_xioctl(m->fd, VIDIOC_QBUF, &buf);
+    }
+    int slot = sequence % UVC_META_FRAMES;
+    if (m->sequence[slot] == sequence) pts = m->pts[slot];
+    const UvcClock *c = &m->clock;
+    if (pts < 0 || !c->valid) return 0;
+    double x = (double) (unwrap(c, (uint32_t) pts) - c->x0);
+    return c->y0 + (int64_t) (c->offset + c->slope * x);
+}
+
+/* Device clock frequency estimated by the fit, 0 before it is ready */
+double uvcmeta_clock_hz(const UvcMeta *m)
+{
+    return (m && m->clock.valid ? 1e9 / m->clock.slope : 0.0);
+}
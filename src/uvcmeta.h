@@ -0,0 +1,43 @@
+#ifndef UVCMETA_H
+#define UVCMETA_H
+#include <stdint.h>
+#include "multicam.h"
+
+/* Clock samples kept for the fit */
+#define UVC_CLOCK_WINDOW 64
+#define UVC_CLOCK_MIN_SAMPLES 8
+
+/* Linear model host_ns = y0 + offset + slope*(device_ticks - x0), fitted by
+   least squares over the last UVC_CLOCK_WINDOW samples */
+typedef struct UvcClock {
+    double x[UVC_CLOCK_WINDOW];   /* Device clock, unwrapped, relative to x0 */
+    double y[UVC_CLOCK_WINDOW];   /* Host time in ns, relative to y0 */
+    int n, head;
+    int64_t x0, y0;
+    uint32_t last_stc;
+    int64_t stc_base;             /* Added to STC to undo 32-bit wraparound */
+    int started;
+    double slope, offset;         /* ns per tick */
+    int valid;
+} UvcClock;
+
+#define UVC_META_FRAMES 8
+
+/* The metadata node paired with a video node, streamed alongside it */
+typedef struct UvcMeta {
+    char *device;
+    int fd;
+    struct buffer *buffers;
+    unsigned int n_buffers;
+    UvcClock clock;
+    uint32_t sequence[UVC_META_FRAMES]; /* PTS of recent frames by sequence number */
+    int64_t pts[UVC_META_FRAMES];
+} UvcMeta;
+
+UvcMeta *uvcmeta_new(const char *device);
+int uvcmeta_start(UvcMeta *m);
+void uvcmeta_stop(UvcMeta *m);
+void uvcmeta_free(UvcMeta *m);
+int64_t uvcmeta_frame_time(UvcMeta *m, uint32_t sequence);
+double uvcmeta_clock_hz(const UvcMeta *m);
+#endif //UVCMETA_H
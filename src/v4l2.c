@@ -1,5 +1,6 @@
 #include <Python.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -9,6 +10,7 @@
 
 #include "v4l2.h"
 #include "libyuv.h" //TODO: remove? Used for FOURCC
+#include "watchdog.h"
 
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
@@ -18,6 +20,38 @@
  * This code is based partly on pyvideograb by Laurent Pointal at
  * http://laurent.pointal.org/python/projets/pyvideograb
 */
+
+/* Last error of the calling thread. Kept out of the Python error state so
+   that devices can be brought up in threads without the GIL. */
+static __thread PyObject *error_type;
+static __thread char error_message[256];
+
+void v4l2_error(PyObject *type, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(error_message, sizeof(error_message), format, ap);
+    va_end(ap);
+    error_type = type;
+}
+
+const char *v4l2_error_message(void)
+{
+    return error_message;
+}
+
+PyObject *v4l2_error_type(void)
+{
+    return (error_type ? error_type : PyExc_SystemError);
+}
+
+/* Raises the last error; needs the GIL. Always returns NULL. */
+PyObject *v4l2_raise(void)
+{
+    PyErr_SetString(v4l2_error_type(), error_message);
+    return NULL;
+}
+
 int v4l2_xioctl (int fd, int request, void *arg)
 {
     int r;
@@ -31,15 +65,32 @@ int v4l2_xioctl (int fd, int request, void *arg)
 }
 
 
+/* Sets up a v4l2_buffer for buffer `index`. With the multi-planar API it
+   points to `planes`, which must hold MAX_PLANES entries. */
+void
+v4l2_prepare_buffer(v4l2camObject *self, struct v4l2_buffer *buf, struct v4l2_plane *planes, unsigned int index)
+{
+    CLEAR(*buf);
+    buf->type = self->buf_type;
+    buf->memory = V4L2_MEMORY_MMAP;
+    buf->index = index;
+    if (self->buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        memset(planes, 0, MAX_PLANES * sizeof(*planes));
+        buf->m.planes = planes;
+        buf->length = MAX_PLANES;
+    }
+}
+
 /* A wrapper around a VIDIOC_S_FMT ioctl to check for format compatibility */
 
 int
 v4l2_set_pixelformat(v4l2camObject *self, struct v4l2_format *fmt, unsigned long pixelformat)
 {
+    //pixelformat is at the same offset in fmt.pix and fmt.pix_mp
     fmt->fmt.pix.pixelformat = pixelformat;
 
     if (-1 == v4l2_xioctl(self->fd, VIDIOC_S_FMT, fmt)) {
-        PyErr_Format(PyExc_SystemError, "%s: set_pixelformat failed (ioctl(VIDIOC_S_FMT))", self->device);
+        v4l2_error(PyExc_SystemError, "%s: set_pixelformat failed (ioctl(VIDIOC_S_FMT))", self->device);
         return 0;
     }
 
@@ -47,7 +98,7 @@ v4l2_set_pixelformat(v4l2camObject *self, struct v4l2_format *fmt, unsigned long
         return 1;
     }
     else {
-        PyErr_Format(PyExc_SystemError, "%s: set_pixelformat failed (ioctl(VIDIOC_S_FMT))", self->device);
+        v4l2_error(PyExc_SystemError, "%s: set_pixelformat failed (ioctl(VIDIOC_S_FMT))", self->device);
         return 0;
     }
 }
@@ -87,7 +138,39 @@ v4l2_set_control(int fd, int id, int value)
     return 1;
 }
 
+static int
+ext_controls(v4l2camObject *self, int request, struct v4l2_ext_control *ctrls, unsigned int count)
+{
+    struct v4l2_ext_controls ext;
+    CLEAR(ext);
+    ext.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ext.count = count;
+    ext.controls = ctrls;
+    if (-1 == v4l2_xioctl(self->fd, request, &ext)) {
+        int err = errno;
+        PyObject *type = ((err == EINVAL || err == ERANGE || err == EACCES) ? PyExc_ValueError : PyExc_EnvironmentError);
+        const char *op = ((unsigned int) request == VIDIOC_S_EXT_CTRLS ? "setting" : "getting");
+        if (ext.error_idx < count)
+            v4l2_error(type, "%s: %s control 0x%08x failed: %d, %s", self->device, op, ctrls[ext.error_idx].id, err, strerror(err));
+        else //Rejected before any was applied
+            v4l2_error(type, "%s: %s controls failed: %d, %s", self->device, op, err, strerror(err));
+        return 0;
+    }
+    return 1;
+}
+
+/* Reads several controls with one VIDIOC_G_EXT_CTRLS */
+int v4l2_get_controls(v4l2camObject *self, struct v4l2_ext_control *ctrls, unsigned int count)
+{
+    return ext_controls(self, VIDIOC_G_EXT_CTRLS, ctrls, count);
+}
 
+/* Sets several controls with one VIDIOC_S_EXT_CTRLS, which the driver
+   applies in order and as one transaction where it can */
+int v4l2_set_controls(v4l2camObject *self, struct v4l2_ext_control *ctrls, unsigned int count)
+{
+    return ext_controls(self, VIDIOC_S_EXT_CTRLS, ctrls, count);
+}
 
 int
 v4l2_query_buffer(v4l2camObject *self)
@@ -96,15 +179,12 @@ v4l2_query_buffer(v4l2camObject *self)
 
     for (i = 0; i < self->n_buffers; ++i) {
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[MAX_PLANES];
 
-        CLEAR(buf);
-
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
+        v4l2_prepare_buffer(self, &buf, planes, i);
 
         if (-1 == v4l2_xioctl(self->fd, VIDIOC_QUERYBUF, &buf)) {
-            PyErr_Format(PyExc_MemoryError, "%s: ioctl(VIDIOC_QUERYBUF) failure : %d, %s", self->device, errno, strerror(errno));
+            v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_QUERYBUF) failure : %d, %s", self->device, errno, strerror(errno));
             return 0;
         }
 
@@ -122,12 +202,13 @@ v4l2_stop_capturing(v4l2camObject *self)
 {
     enum v4l2_buf_type type;
 
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    type = self->buf_type;
 
     if (-1 == v4l2_xioctl(self->fd, VIDIOC_STREAMOFF, &type)) {
-        PyErr_Format(PyExc_SystemError, "%s: ioctl(VIDIOC_STREAMOFF) failure : %d, %s", self->device, errno, strerror(errno));
+        v4l2_error(PyExc_SystemError, "%s: ioctl(VIDIOC_STREAMOFF) failure : %d, %s", self->device, errno, strerror(errno));
         return 0;
     }
+    self->streaming = 0;
 
     return 1;
 }
@@ -140,25 +221,24 @@ v4l2_start_capturing(v4l2camObject *self)
 
     for (i = 0; i < self->n_buffers; ++i) {
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[MAX_PLANES];
 
-        CLEAR(buf);
-
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
+        v4l2_prepare_buffer(self, &buf, planes, i);
 
         if (-1 == v4l2_xioctl(self->fd, VIDIOC_QBUF, &buf)) {
-            PyErr_Format(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_QBUF) failure : %d, %s", self->device, errno, strerror(errno));
+            v4l2_error(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_QBUF) failure : %d, %s", self->device, errno, strerror(errno));
             return 0;
         }
     }
 
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    type = self->buf_type;
 
     if (-1 == v4l2_xioctl(self->fd, VIDIOC_STREAMON, &type)) {
-        PyErr_Format(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_STREAMON) failure : %d, %s", self->device, errno, strerror(errno));
+        v4l2_error(PyExc_EnvironmentError, "%s: ioctl(VIDIOC_STREAMON) failure : %d, %s", self->device, errno, strerror(errno));
         return 0;
     }
+    self->streaming = 1;
+    self->last_frame_ns = monotonic_ns();
 
     return 1;
 }
@@ -168,14 +248,18 @@ v4l2_uninit_device(v4l2camObject *self)
 {
     unsigned int i;
 
-    for (i = 0; i < self->n_buffers; ++i) {
+    for (i = 0; i < self->n_buffers * self->n_planes; ++i) {
+        if (self->buffers[i].start == NULL || self->buffers[i].start == MAP_FAILED)
+            continue;
         if (-1 == munmap(self->buffers[i].start, self->buffers[i].length)) {
-            PyErr_Format(PyExc_MemoryError, "%s: munmap failure: %d, %s", self->device, errno, strerror(errno));
+            v4l2_error(PyExc_MemoryError, "%s: munmap failure: %d, %s", self->device, errno, strerror(errno));
             return 0;
         }
     }
 
     free(self->buffers);
+    self->buffers = NULL;
+    self->n_buffers = 0;
 
     return 1;
 }
@@ -191,56 +275,60 @@ v4l2_init_mmap(v4l2camObject *self)
        It will likely result in buffer overruns, but for purposes of gaming,
        it is probably better to drop frames than get old frames. */
     req.count = 5;
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.type = self->buf_type;
     req.memory = V4L2_MEMORY_MMAP;
 
     if (-1 == v4l2_xioctl(self->fd, VIDIOC_REQBUFS, &req)) {
         if (EINVAL == errno) {
-            PyErr_Format(PyExc_MemoryError, "%s does not support memory mapping",self->device);
+            v4l2_error(PyExc_MemoryError, "%s does not support memory mapping",self->device);
             return 0;
         }
         else {
-            PyErr_Format(PyExc_MemoryError, "%s: ioctl(VIDIOC_REQBUFS) failure : %d, %s", self->device, errno, strerror(errno));
+            v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_REQBUFS) failure : %d, %s", self->device, errno, strerror(errno));
             return 0;
         }
     }
 
     if (req.count < 2) {
-        PyErr_Format(PyExc_MemoryError, "%s: Insufficient buffer memory\n", self->device);
+        v4l2_error(PyExc_MemoryError, "%s: Insufficient buffer memory\n", self->device);
         return 0;
     }
 
-    self->buffers = calloc(req.count, sizeof(*self->buffers));
+    self->buffers = calloc(req.count * self->n_planes, sizeof(*self->buffers));
 
     if (!self->buffers) {
-        PyErr_Format(PyExc_MemoryError, "Out of memory");
+        v4l2_error(PyExc_MemoryError, "Out of memory");
         return 0;
     }
 
     for (self->n_buffers = 0; self->n_buffers < req.count; ++self->n_buffers) {
         struct v4l2_buffer buf;
+        struct v4l2_plane planes[MAX_PLANES];
 
-        CLEAR(buf);
-
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = self->n_buffers;
+        v4l2_prepare_buffer(self, &buf, planes, self->n_buffers);
 
         if (-1 == v4l2_xioctl(self->fd, VIDIOC_QUERYBUF, &buf)) {
-            PyErr_Format(PyExc_MemoryError, "%s: ioctl(VIDIOC_QUERYBUF) failure : %d, %s", self->device, errno, strerror(errno));
+            v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_QUERYBUF) failure : %d, %s", self->device, errno, strerror(errno));
             // free(self->buffers);
             return 0;
         }
 
-        self->buffers[self->n_buffers].length = buf.length;
-        self->buffers[self->n_buffers].start =
-            mmap(NULL /* start anywhere */, buf.length,
-                 PROT_READ | PROT_WRITE /* required */,
-                 MAP_SHARED /* recommended */, self->fd, buf.m.offset);
-
-        if (MAP_FAILED == self->buffers[self->n_buffers].start) {
-            PyErr_Format(PyExc_MemoryError, "%s: mmap failure : %d, %s", self->device, errno, strerror(errno));
-            return 0;
+        //Map each plane separately; single-planar buffers have one
+        for (unsigned int p = 0; p < self->n_planes; ++p) {
+            struct buffer *b = &self->buffers[self->n_buffers * self->n_planes + p];
+            int mplane = (self->buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+            b->length = (mplane ? planes[p].length : buf.length);
+            b->start = mmap(NULL /* start anywhere */, b->length,
+                            PROT_READ | PROT_WRITE /* required */,
+                            MAP_SHARED /* recommended */, self->fd,
+                            (mplane ? planes[p].m.mem_offset : buf.m.offset));
+
+            if (MAP_FAILED == b->start) {
+                b->start = NULL;
+                self->n_buffers++; //Unmap what was mapped of this buffer too
+                v4l2_error(PyExc_MemoryError, "%s: mmap failure : %d, %s", self->device, errno, strerror(errno));
+                return 0;
+            }
         }
     }
 
@@ -253,63 +341,92 @@ int v4l2_test_valid_device(int fd, char* device)
     struct v4l2_capability cap;
     if (-1 == v4l2_xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
         if (EINVAL == errno) {
-            PyErr_Format(PyExc_SystemError, "%s is not a V4L2 device", device);
+            v4l2_error(PyExc_SystemError, "%s is not a V4L2 device", device);
             return 0;
         }
         else {
-            PyErr_Format(PyExc_SystemError, "%s: ioctl(VIDIOC_QUERYCAP) failure : %d, %s", device, errno, strerror(errno));
+            v4l2_error(PyExc_SystemError, "%s: ioctl(VIDIOC_QUERYCAP) failure : %d, %s", device, errno, strerror(errno));
             return 0;
         }
     }
 
-    if (!(cap.device_caps & V4L2_CAP_VIDEO_CAPTURE)) {
-        PyErr_Format(PyExc_SystemError, "%s is not a video capture device", device);
+    if (!(cap.device_caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE))) {
+        v4l2_error(PyExc_SystemError, "%s is not a video capture device", device);
         return 0;
     }
 
     if (!(cap.device_caps & V4L2_CAP_STREAMING)) {
-        PyErr_Format(PyExc_SystemError, "%s does not support streaming i/o", device);
+        v4l2_error(PyExc_SystemError, "%s does not support streaming i/o", device);
         return 0;
     }
-    return 1;
+    //Prefer the single-planar API when both are offered
+    return ((cap.device_caps & V4L2_CAP_VIDEO_CAPTURE) ? 1 : 2);
 }
 
+/* Frame interval for `fps`, exact to 1/1000 fps: 30 -> 1/30, 29.97 -> 100/2997 */
 struct v4l2_fract float2fract(float fps) {
-    float k=1, r;
-    r = fmod(fps,1);
-    if (r > 0) k = 1.0f/r;
-    
-    printf("%f %f %i %i\n", fps, r, (unsigned int) k, (unsigned int) (k*fps));
-    struct v4l2_fract res = {(unsigned int) k, (unsigned int) (k*fps)};
+    unsigned int num = 1000, den = (unsigned int) lroundf(fps*1000), a, b, t;
+    for (a = num, b = den; b; t = a % b, a = b, b = t);
+    struct v4l2_fract res = {num/a, den/a};
     return res;
 }
 
-int v4l2_init_device(v4l2camObject *self)
+/* Negotiates width, height and fourcc with VIDIOC_S_FMT. Needs buf_type set
+   and no buffers allocated. */
+int v4l2_set_format(v4l2camObject *self)
 {
-
     struct v4l2_format fmt;
 
-    if (!v4l2_test_valid_device(self->fd, self->device)) return 0;
-
     CLEAR(fmt);
 
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = self->width;
-    fmt.fmt.pix.height = self->height;
-    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    fmt.type = self->buf_type;
+    if (self->buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        fmt.fmt.pix_mp.width = self->width;
+        fmt.fmt.pix_mp.height = self->height;
+        fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+    }
+    else {
+        fmt.fmt.pix.width = self->width;
+        fmt.fmt.pix.height = self->height;
+        fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    }
 
     if (!v4l2_set_pixelformat(self, &fmt, self->fourcc)) {
         return 0;
     }
 
-    /* Note VIDIOC_S_FMT may change width and height. */
+    if (self->buf_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        if (fmt.fmt.pix_mp.num_planes < 1 || fmt.fmt.pix_mp.num_planes > MAX_PLANES) {
+            v4l2_error(PyExc_SystemError, "%s: unsupported number of planes: %d", self->device, fmt.fmt.pix_mp.num_planes);
+            return 0;
+        }
+        self->n_planes = fmt.fmt.pix_mp.num_planes;
+        for (unsigned int p = 0; p < self->n_planes; ++p)
+            self->plane_stride[p] = fmt.fmt.pix_mp.plane_fmt[p].bytesperline;
+        self->bytesperline = self->plane_stride[0];
+        self->sizeimage = fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+    }
+    else {
+        self->n_planes = 1;
+        self->bytesperline = self->plane_stride[0] = fmt.fmt.pix.bytesperline;
+        self->sizeimage = fmt.fmt.pix.sizeimage;
+    }
+
+    /* Note VIDIOC_S_FMT may change width and height. pix and pix_mp share
+       the width/height/pixelformat layout, so fmt.pix works for both. */
     if (((unsigned int) self->width != fmt.fmt.pix.width) || ( (unsigned int) self->height != fmt.fmt.pix.height)) {
-        PyErr_Format(PyExc_SystemError, "%s: Failed while setting size=(%d,%d). Got (%d,%d).", self->device, self->width, self->height, fmt.fmt.pix.width, fmt.fmt.pix.height);
+        v4l2_error(PyExc_SystemError, "%s: Failed while setting size=(%d,%d). Got (%d,%d).", self->device, self->width, self->height, fmt.fmt.pix.width, fmt.fmt.pix.height);
         return 0;  
     }   
+    return 1;
+}
 
+/* Sets the frame rate with VIDIOC_S_PARM. Needs streaming off. */
+int v4l2_set_fps(v4l2camObject *self)
+{
     struct v4l2_streamparm parm;
-    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    CLEAR(parm);
+    parm.type = self->buf_type;
     //v4l2_xioctl(self->fd, VIDIOC_G_PARM, &parm);
     parm.parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
     
@@ -320,20 +437,99 @@ int v4l2_init_device(v4l2camObject *self)
     parm.parm.capture.timeperframe = targetfps;
     
     if (-1 == v4l2_xioctl(self->fd, VIDIOC_S_PARM, &parm)) {
-        PyErr_Format(PyExc_SystemError, "%s: Failed while setting fps=%S", self->device, PyFloat_FromDouble((double) self->fps));
+        v4l2_error(PyExc_SystemError, "%s: Failed while setting fps=%g", self->device, (double) self->fps);
         return 0;
     }
     
-    if ((parm.parm.capture.timeperframe.numerator != targetfps.numerator) || (parm.parm.capture.timeperframe.denominator != targetfps.denominator)) {
-        float actualfps = 1.0*parm.parm.capture.timeperframe.denominator/parm.parm.capture.timeperframe.numerator;
-        PyErr_Format(PyExc_SystemError, "%s: Failed while setting fps=%S. Got %S.", self->device, PyFloat_FromDouble((double) self->fps), PyFloat_FromDouble((double) actualfps));
+    //Drivers may round the interval (e.g. 1001/30000 for 30), so allow 0.5%
+    float actualfps = (parm.parm.capture.timeperframe.numerator ?
+                       1.0*parm.parm.capture.timeperframe.denominator/parm.parm.capture.timeperframe.numerator : 0);
+    if (fabsf(actualfps - self->fps) > 0.005f*self->fps) {
+        v4l2_error(PyExc_SystemError, "%s: Failed while setting fps=%g. Got %g.", self->device, (double) self->fps, (double) actualfps);
         return 0;
     }
+    return 1;
+}
+
+int v4l2_init_device(v4l2camObject *self)
+{
+    int valid = v4l2_test_valid_device(self->fd, self->device);
+    if (!valid) return 0;
+    self->buf_type = (valid == 2 ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE);
+
+    if (!(v4l2_set_format(self) && v4l2_set_fps(self) && v4l2_init_mmap(self)))
+        return 0;
+    v4l2_watch_exposure(self);
+    return 1;
+}
 
-    if (!v4l2_init_mmap(self)) {
+/* Follows the exposure time through control events: the current value
+   arrives as the first event, and later changes, including those made by
+   auto exposure and through this fd, as they happen. Without events the
+   value is read once. Cameras without the control report 0. */
+void v4l2_watch_exposure(v4l2camObject *self)
+{
+    struct v4l2_event_subscription sub;
+    CLEAR(sub);
+    sub.type = V4L2_EVENT_CTRL;
+    sub.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+    sub.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL | V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK;
+    self->exposure = 0;
+    self->exposure_events = (0 == v4l2_xioctl(self->fd, VIDIOC_SUBSCRIBE_EVENT, &sub));
+    if (!self->exposure_events && !v4l2_get_control(self->fd, V4L2_CID_EXPOSURE_ABSOLUTE, &self->exposure))
+        self->exposure = 0;
+    v4l2_poll_events(self);
+}
+
+/* Applies pending control events; does not block */
+void v4l2_poll_events(v4l2camObject *self)
+{
+    struct v4l2_event ev;
+    if (!self->exposure_events) return;
+    for (;;) {
+        CLEAR(ev);
+        if (-1 == v4l2_xioctl(self->fd, VIDIOC_DQEVENT, &ev)) //ENOENT: none pending
+            return;
+        if (ev.type == V4L2_EVENT_CTRL && ev.id == V4L2_CID_EXPOSURE_ABSOLUTE &&
+            (ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE))
+            self->exposure = ev.u.ctrl.value;
+    }
+}
+
+/* Mid-exposure time of a dequeued frame on CLOCK_MONOTONIC. The driver's
+   timestamp marks the start of exposure or the end of the frame (flag
+   V4L2_BUF_FLAG_TSTAMP_SRC_*), so half an exposure is added or subtracted.
+   Timestamps that are not monotonic are replaced by the dequeue time, the
+   closest known bound on the end of the frame. */
+int64_t v4l2_frame_timestamp(v4l2camObject *self, const struct v4l2_buffer *buf, int64_t dequeued_ns)
+{
+    int64_t half = (int64_t) self->exposure * 50000; //100 us units
+    int64_t t = (int64_t) buf->timestamp.tv_sec * 1000000000LL + (int64_t) buf->timestamp.tv_usec * 1000;
+    if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC || t == 0)
+        return dequeued_ns - half;
+    if ((buf->flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE)
+        return t + half;
+    return t - half;
+}
+
+/* Unmaps the buffers and releases them in the driver, which must happen
+   before the format can change. Needs streaming off. */
+int v4l2_free_buffers(v4l2camObject *self)
+{
+    struct v4l2_requestbuffers req;
+
+    if (!v4l2_uninit_device(self))
+        return 0;
+
+    CLEAR(req);
+    req.count = 0;
+    req.type = self->buf_type;
+    req.memory = V4L2_MEMORY_MMAP;
+
+    if (-1 == v4l2_xioctl(self->fd, VIDIOC_REQBUFS, &req)) {
+        v4l2_error(PyExc_MemoryError, "%s: ioctl(VIDIOC_REQBUFS) failure : %d, %s", self->device, errno, strerror(errno));
         return 0;
     }
-       
     return 1;
 }
 
@@ -344,7 +540,7 @@ v4l2_close_device(v4l2camObject *self)
         return 1;
 
     if (-1 == close(self->fd)) {
-        PyErr_Format(PyExc_SystemError, "Cannot close '%s': %d, %s", self->device, errno, strerror(errno));
+        v4l2_error(PyExc_SystemError, "Cannot close '%s': %d, %s", self->device, errno, strerror(errno));
         return 0;
     }
     self->fd = -1;
@@ -358,19 +554,20 @@ v4l2_open_device(v4l2camObject *self)
     struct stat st;
 
     if (-1 == stat(self->device, &st)) {
-        PyErr_Format(PyExc_SystemError, "Cannot stat '%s': %d, %s", self->device, errno, strerror(errno));
+        v4l2_error(PyExc_SystemError, "Cannot stat '%s': %d, %s", self->device, errno, strerror(errno));
         goto return_err;
     }
 
     if (!S_ISCHR(st.st_mode)) {
-        PyErr_Format(PyExc_SystemError, "%s is not a device", self->device);
+        v4l2_error(PyExc_SystemError, "%s is not a device", self->device);
         goto return_err;
     }
 
-    self->fd = open(self->device, O_RDWR, 0);
+    //Non-blocking: readers wait in poll() so the watchdog can get in between
+    self->fd = open(self->device, O_RDWR | O_NONBLOCK, 0);
 
     if (-1 == self->fd) {
-        PyErr_Format(PyExc_SystemError, "Cannot open '%s': %d, %s", self->device, errno, strerror(errno));
+        v4l2_error(PyExc_SystemError, "Cannot open '%s': %d, %s", self->device, errno, strerror(errno));
         goto return_err;
     }
     return 1;
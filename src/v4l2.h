@@ -1,17 +1,32 @@
 #ifndef V4L2_H
 #define V4L2_H
 #include "multicam.h"
+/* Failing functions return 0 and record an error with v4l2_error() for the
+   calling thread; v4l2_raise() turns it into a Python exception. */
+void v4l2_error(PyObject *type, const char *format, ...);
+const char *v4l2_error_message(void);
+PyObject *v4l2_error_type(void);
+PyObject *v4l2_raise(void);
 int v4l2_close_device(v4l2camObject *self);
+void v4l2_prepare_buffer(v4l2camObject *self, struct v4l2_buffer *buf, struct v4l2_plane *planes, unsigned int index);
 int v4l2_get_control(int fd, int id, int *value);
+int v4l2_get_controls(v4l2camObject *self, struct v4l2_ext_control *ctrls, unsigned int count);
+int v4l2_free_buffers(v4l2camObject *self);
 int v4l2_init_device(v4l2camObject *self);
 int v4l2_init_mmap(v4l2camObject *self);
 int v4l2_open_device(v4l2camObject *self);
 int v4l2_query_buffer(v4l2camObject *self);
 int v4l2_set_control(int fd, int id, int value);
+int v4l2_set_controls(v4l2camObject *self, struct v4l2_ext_control *ctrls, unsigned int count);
+int v4l2_set_format(v4l2camObject *self);
+int v4l2_set_fps(v4l2camObject *self);
 int v4l2_set_pixelformat(v4l2camObject *self, struct v4l2_format *fmt, unsigned long pixelformat);
 int v4l2_start_capturing(v4l2camObject *self);
 int v4l2_stop_capturing(v4l2camObject *self);
 int v4l2_uninit_device(v4l2camObject *self);
 int v4l2_test_valid_device(int fd, char *device);
 int v4l2_xioctl(int fd, int request, void *arg);
+void v4l2_watch_exposure(v4l2camObject *self);
+void v4l2_poll_events(v4l2camObject *self);
+int64_t v4l2_frame_timestamp(v4l2camObject *self, const struct v4l2_buffer *buf, int64_t dequeued_ns);
 #endif //V4L2_H
@@ -0,0 +1,175 @@
+#include <Python.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <linux/videodev2.h>
+#include "v4l2.h"
+#include "watchdog.h"
+
+/*
+ * Stall watchdog. Some UVC cameras stop delivering frames while their fd
+ * stays valid, which looks like a long wait in the reader. One thread checks
+ * every watched camera a few times per second: a camera with frames queued
+ * (POLLIN) or read recently is alive; one silent for longer than its stall
+ * timeout gets its stream cycled (STREAMOFF, requeue, STREAMON), and if that
+ * brings no frame either, the device is closed and reopened. The thread only
+ * uses plain C and the cameras' io_locks, never the GIL; a camera whose lock
+ * is busy is in the middle of a read, so it is skipped. A restart runs
+ * without the list lock, so adding and removing other cameras, which may
+ * happen with the GIL held, does not wait for a reopen to finish.
+*/
+
+#define WATCHDOG_PERIOD_NS 100000000LL
+#define STALL_FRAMES 10     /* Frame intervals before the auto timeout */
+#define STALL_MIN_S 2.0     /* Some cameras take a second for their first frame */
+
+static pthread_mutex_t wd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wd_cond;
+static pthread_cond_t wd_recovered = PTHREAD_COND_INITIALIZER;
+static v4l2camObject **wd_cams;
+static int wd_n, wd_cap;
+static int wd_started;
+
+int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double
+stall_timeout(v4l2camObject *cam)
+{
+    if (cam->stall_timeout > 0) return cam->stall_timeout;
+    double t = (cam->fps > 0 ? STALL_FRAMES / cam->fps : 0.0);
+    return (t > STALL_MIN_S ? t : STALL_MIN_S);
+}
+
+/* Restarts the stream of a stalled camera; called with its io_lock held */
+static void
+recover(v4l2camObject *cam, int64_t now)
+{
+    double silent = (now - cam->last_frame_ns) * 1e-9;
+    cam->stalls++;
+    cam->last_stall = now * 1e-9;
+    if (cam->stall_level == 0) {
+        fprintf(stderr, "%s: no frame for %.1f s, restarting stream\n", cam->device, silent);
+        cam->stall_restarts++;
+        v4l2_stop_capturing(cam);
+        cam->streaming = 0;
+        if (v4l2_start_capturing(cam)) {
+            cam->stall_level = 1;
+            cam->last_frame_ns = now;
+            return;
+        }
+    }
+    fprintf(stderr, "%s: no frame for %.1f s, reopening device\n", cam->device, silent);
+    cam->stall_reopens++;
+    if (cam->streaming) v4l2_stop_capturing(cam);
+    cam->streaming = 0;
+    v4l2_uninit_device(cam);
+    v4l2_close_device(cam);
+    if (!(v4l2_open_device(cam) && v4l2_init_device(cam) && v4l2_start_capturing(cam))) {
+        //Left closed; the next read reports the camera as lost
+        fprintf(stderr, "%s: reopening failed: %s\n", cam->device, v4l2_error_message());
+        if (cam->buffers) v4l2_uninit_device(cam);
+        v4l2_close_device(cam);
+        return;
+    }
+    cam->stall_level = 2;
+    cam->last_frame_ns = now;
+}
+
+/* Called with wd_lock held, which is released while the camera recovers */
+static void
+check(v4l2camObject *cam, int64_t now)
+{
+    if (pthread_mutex_trylock(&cam->io_lock) != 0)
+        return;
+    if (cam->fd == -1 || !cam->streaming || cam->stall_timeout < 0) {
+        cam->last_frame_ns = now; //Paused: the clock starts again on resume
+    }
+    else {
+        struct pollfd pfd = {cam->fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+            cam->last_frame_ns = now;
+            cam->stall_level = 0;
+        }
+        else if (now - cam->last_frame_ns > (int64_t) (stall_timeout(cam) * 1e9)) {
+            cam->recovering = 1; //watchdog_remove waits for it to clear
+            pthread_mutex_unlock(&wd_lock);
+            recover(cam, now);
+            pthread_mutex_unlock(&cam->io_lock);
+            pthread_mutex_lock(&wd_lock);
+            cam->recovering = 0;
+            pthread_cond_broadcast(&wd_recovered);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&cam->io_lock);
+}
+
+static void *
+watchdog_run(void *arg)
+{
+    (void) arg;
+    pthread_mutex_lock(&wd_lock);
+    for (;;) {
+        int64_t next = monotonic_ns() + WATCHDOG_PERIOD_NS;
+        struct timespec ts = {next / 1000000000LL, next % 1000000000LL};
+        while (pthread_cond_timedwait(&wd_cond, &wd_lock, &ts) != ETIMEDOUT && wd_n > 0);
+        while (wd_n == 0) //Idle until a camera is watched
+            pthread_cond_wait(&wd_cond, &wd_lock);
+        int64_t now = monotonic_ns();
+        for (int i = 0; i < wd_n; i++) //The list may change while a camera recovers
+            check(wd_cams[i], now);
+    }
+    return NULL;
+}
+
+void watchdog_add(v4l2camObject *cam)
+{
+    pthread_mutex_lock(&wd_lock);
+    if (!wd_started) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&wd_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_t thread;
+        wd_started = (pthread_create(&thread, NULL, watchdog_run, NULL) == 0);
+        if (wd_started) pthread_detach(thread);
+    }
+    for (int i = 0; i < wd_n; i++)
+        if (wd_cams[i] == cam) goto RETURN;
+    if (wd_n == wd_cap) {
+        int cap = (wd_cap ? wd_cap * 2 : 8);
+        v4l2camObject **cams = realloc(wd_cams, cap * sizeof(*cams));
+        if (!cams) goto RETURN; //Left unwatched
+        wd_cams = cams;
+        wd_cap = cap;
+    }
+    cam->last_frame_ns = monotonic_ns();
+    cam->stall_level = 0;
+    wd_cams[wd_n++] = cam;
+    pthread_cond_signal(&wd_cond);
+    RETURN:
+    pthread_mutex_unlock(&wd_lock);
+}
+
+/* Returns once the watchdog is done with the camera */
+void watchdog_remove(v4l2camObject *cam)
+{
+    pthread_mutex_lock(&wd_lock);
+    for (int i = 0; i < wd_n; i++) {
+        if (wd_cams[i] == cam) {
+            wd_cams[i] = wd_cams[--wd_n];
+            break;
+        }
+    }
+    while (cam->recovering)
+        pthread_cond_wait(&wd_recovered, &wd_lock);
+    pthread_mutex_unlock(&wd_lock);
+}
@@ -0,0 +1,11 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+#include <stdint.h>
+#include "multicam.h"
+
+int64_t monotonic_ns(void);
+/* Cameras are watched from bring-up to tear-down. Neither function may be
+   called with the camera's io_lock held. */
+void watchdog_add(v4l2camObject *cam);
+void watchdog_remove(v4l2camObject *cam);
+#endif //WATCHDOG_H
@@ -0,0 +1,93 @@
+'''
+  Discovery against a fake sysfs and udev tree; no camera needed.
+
+  Run with the built package on the path: python3 -m unittest discover tests
+'''
+from pathlib import Path
+import os
+import tempfile
+import unittest
+import multicam as mc
+from multicam.discovery import Discovery
+
+USB = "devices/pci0000:00/0000:00:14.0/usb1/1-2"
+
+def add_node(root, name, minor, parent, index=0, driver="uvcvideo", caps=":capture:"):
+    node = root / "sys" / parent / "video4linux" / name
+    node.mkdir(parents=True)
+    (node / "name").write_text(f"Camera {name}\n")
+    (node / "index").write_text(f"{index}\n")
+    (node / "dev").write_text(f"81:{minor}\n")
+    os.symlink(os.path.relpath(node.parent.parent, node), node / "device")
+    drv = root / "sys" / "bus" / "drivers" / driver
+    drv.mkdir(parents=True, exist_ok=True)
+    if not (node.parent.parent / "driver").exists():
+        os.symlink(os.path.relpath(drv, node.parent.parent), node.parent.parent / "driver")
+    cls = root / "sys" / "class" / "video4linux"
+    cls.mkdir(parents=True, exist_ok=True)
+    os.symlink(os.path.relpath(node, cls), cls / name)
+    if caps is not None:
+        data = root / "udev" / "data"
+        data.mkdir(parents=True, exist_ok=True)
+        (data / f"c81:{minor}").write_text(f"E:ID_V4L_VERSION=2\nE:ID_V4L_CAPABILITIES={caps}\n")
+    return node
+
+class FakeTree(unittest.TestCase):
+    def setUp(self):
+        self._tmp = tempfile.TemporaryDirectory()
+        self.root = Path(self._tmp.name)
+        usb = self.root / "sys" / USB
+        usb.mkdir(parents=True)
+        (usb / "idVendor").write_text("046d\n")
+        (usb / "idProduct").write_text("082d\n")
+        (usb / "serial").write_text("ABC123\n")
+        add_node(self.root, "video0", 0, USB + "/1-2:1.0")
+        add_node(self.root, "video1", 1, USB + "/1-2:1.0", index=1, caps=":")
+        add_node(self.root, "video2", 2, "devices/platform/codec", driver="bcm2835-codec", caps=":video_m2m:")
+        add_node(self.root, "video3", 3, "devices/virtual/loop", driver="v4l2loopback", caps=":video_output:")
+        add_node(self.root, "video4", 4, "devices/platform/isp", driver="isp", caps=None) #Not in udev yet
+        mc.set_sysfs_root(self.root / "sys", self.root / "dev", self.root / "udev")
+
+    def tearDown(self):
+        mc.set_sysfs_root()
+        self._tmp.cleanup()
+
+    def test_list_cams_keeps_capture_nodes(self):
+        #video4 is unknown to udev, so it is opened, which fails in the fake tree
+        self.assertEqual(mc.list_cams(), [self.root / "dev" / "video0"])
+
+    def test_identity(self):
+        d = {v.path.name: v for v in mc.discover()}
+        self.assertEqual((d["video0"].usb_path, d["video0"].serial, d["video0"].vendor_id), ("1-2", "ABC123", "046d"))
+        self.assertTrue(d["video1"].is_metadata)
+        self.assertEqual(d["video2"].driver, "bcm2835-codec")
+        self.assertIsNone(d["video4"].is_capture)
+        self.assertEqual(mc.find_device(serial="ABC123").path.name, "video0")
+
+    def test_reregistered_node_is_reread(self):
+        self.assertEqual(mc.discover()[0].name, "Camera video0")
+        link = self.root / "sys" / "class" / "video4linux" / "video0"
+        target = os.readlink(link)
+        os.unlink(link)
+        (self.root / "sys" / USB / "1-2:1.0" / "video4linux" / "video0" / "name").write_text("Replugged\n")
+        os.symlink(target, link)
+        self.assertEqual(mc.discover()[0].name, "Replugged")
+
+    def test_udev_record_arriving_later(self):
+        self.assertIsNone(next(v for v in mc.discover() if v.path.name == "video4").is_capture)
+        (self.root / "udev" / "data" / "c81:4").write_text("E:ID_V4L_CAPABILITIES=:capture:\n")
+        os.utime(self.root / "udev" / "data", ns=(0, 1)) #Coarse clocks may not move the mtime
+        self.assertTrue(next(v for v in mc.discover() if v.path.name == "video4").is_capture)
+
+    def test_relative_root(self):
+        cwd = os.getcwd()
+        os.chdir(self.root)
+        try:
+            d = Discovery("sys", "dev", "udev").devices()
+        finally:
+            os.chdir(cwd)
+        self.assertEqual(d[0].usb_path, "1-2")
+        self.assertEqual(d[0].path, self.root / "dev" / "video0")
+
+if __name__ == "__main__":
+    unittest.main()